@@ -1,249 +1,217 @@
 #include "analyzer.h"
-#include <stdlib.h>
-#include <assert.h>
-#include <string.h>
 
-static void an_process_destroy(struct an_process *process)
-{
-    if (process == NULL)
-        return;
-
-    for (int i=0; process->args[i] != NULL; ++i)
-        free(process->args[i]);
-
-    free(process->args);
-    free(process->progname.fname);
-    free(process);
-}
-
-void an_pipeline_destroy(struct an_pipeline *pipeline)
+/**
+ * Tokens are not NUL-terminated, but exec() wants C strings.
+ */
+static inline char *span_str(struct arena *arena, struct span text)
 {
-    if (pipeline == NULL)
-        return;
-
-    if (pipeline->file_in != NULL)
-        free(pipeline->file_in->fname);
-
-    if (pipeline->file_out != NULL)
-        free(pipeline->file_out->fname);
-
-    list_destroy(pipeline->procs, (void (*)(void *))an_process_destroy);
-    free(pipeline);
+    return arena_strndup(arena, text.data, text.len);
 }
 
 /**
- * We parse a <name> <arglist>
+ * The state of a single-pass analysis. The parser tells us which
+ * production it is in, and that decides what the next <name> is.
  */
-static struct an_process *get_process(struct parse *tree)
-{
+struct an_builder {
+    struct arena *arena;
+    struct llist *pipelines;
+    struct an_pipeline *pipeline;
     struct an_process *proc;
-    struct parse *child;
-    struct parse *sibling;
-    struct llist *proc_args;
-    char *progname;
-    bool pname_rel;
-
-    assert(tree->type == PROD_NAME);
-    child = tree->lchild;
-    assert(child->type == PROD_TERMINAL);
-
-    /* get the command name */
-    progname = child->token->str_data;
-    pname_rel = child->token->cat == CAT_PATH_REL || progname[0] == '/';
-
-    /* allocate space */
-    proc = calloc(1, sizeof(*proc));
-    proc_args = list_new();
-
-    proc->progname.fname = strdup(progname);
-    proc->progname.is_rel = pname_rel;
-
-    /* build a list of all arguments */
-    sibling = tree->rsibling;
-    while (!prstree_empty(sibling)) {
-        child = sibling->lchild;
-        if (sibling->type == PROD_ARGLIST) {
-            sibling = child;
-            continue;
-        }
-        assert(sibling->type == PROD_NAME);
-        assert(child->type == PROD_TERMINAL);
-        list_append(proc_args, strdup(child->token->str_data));
-        sibling = sibling->rsibling;
-    }
-
-    proc->num_args = proc_args->size + 2;
-
-    /* convert list of strings to array of strings */
-    char **arg_arr = calloc(proc->num_args, sizeof(*arg_arr));
-
-    arg_arr[0] = strdup(proc->progname.fname);
-    for (size_t i=1; i<proc->num_args-1; ++i)
-        arg_arr[i] = list_remove_start(proc_args);
-    
     /**
-     * Since we used calloc, the argument list is NULL-terminated.
-     * arg_arr[proc->num_args - 1] == NULL
+     * The number of slots in proc->args.
      */
+    size_t args_capacity;
+    enum {
+        ROLE_PROGNAME,
+        ROLE_ARG,
+        ROLE_FILE_IN,
+        ROLE_FILE_OUT
+    } role;
+    /**
+     * Set when the arena runs out of memory; the rest is ignored.
+     */
+    bool nomem;
+};
 
-    proc->args = arg_arr;
+static void builder_expand(void *ctx, enum prod prod)
+{
+    struct an_builder *b = ctx;
 
-    /* cleanup */
-    list_destroy(proc_args, NULL);
+    if (b->nomem)
+        return;
 
-    return proc;
+    switch (prod) {
+        case PROD_PIPELINE:
+            b->pipeline = arena_calloc(b->arena, 1, sizeof(*b->pipeline));
+            if (b->pipeline == NULL
+                    || (b->pipeline->procs = list_new_arena(b->arena)) == NULL
+                    || list_append(b->pipelines, b->pipeline) == -1) {
+                b->nomem = true;
+                return;
+            }
+            b->role = ROLE_PROGNAME;
+            break;
+        case PROD_PIPELINE_TAIL:
+            b->role = ROLE_PROGNAME;
+            break;
+        case PROD_ARGLIST:
+            b->role = ROLE_ARG;
+            break;
+        case PROD_STDIN_PIPE:
+            b->role = ROLE_FILE_IN;
+            break;
+        case PROD_STDOUT_PIPE:
+            b->role = ROLE_FILE_OUT;
+            break;
+        default:
+            break;
+    }
 }
 
-static struct an_pipeline *get_pipeline(struct parse *tree)
+/**
+ * Returns NULL if the arena is out of memory.
+ */
+static struct an_path *builder_path(struct an_builder *b, const struct token *tk)
 {
-    struct an_pipeline *pipeline;
-    struct an_process *proc;
-    struct llist *pathnodes;
-    struct parse *child;
-
-    assert(tree->type == PROD_PIPELINE);
-    pipeline = calloc(1, sizeof(*pipeline));
-    pipeline->procs = list_new();
-
-    /* get arguments to first process */
-    child = tree->lchild; /* at <name> */
-    proc = get_process(child);
-    list_append(pipeline->procs, proc);
-
-    child = child->rsibling; /* at <arglist> */
-
-    child = child->rsibling; /* at <stdin_pipe> */
-    if (!prstree_empty(child)) {
-        struct parse *child2;
-
-        /* this takes us to the <name> */
-        child2 = child->lchild->rsibling;
-        assert(child2->type == PROD_NAME);
-        /* this takes us to the terminal inside <name> */
-        child2 = child2->lchild;
-
-        pipeline->file_in = calloc(1, sizeof(*pipeline->file_in));
-        pipeline->file_in->fname = strdup(child2->token->str_data);
-        pipeline->file_in->is_rel = 
-            child2->token->cat == CAT_PATH_REL || pipeline->file_in->fname[0] == '/';
-    }
+    struct an_path *path = arena_calloc(b->arena, 1, sizeof(*path));
 
-    /* advance to <pipeline_tail> */
-    child = child->rsibling;
+    if (path == NULL || (path->fname = span_str(b->arena, tk->text)) == NULL)
+        return NULL;
+    path->is_rel = tk->cat == CAT_PATH_REL || path->fname[0] == '/';
 
-    /* get all subsequent processes */
-    pathnodes = list_new();
-    list_append(pathnodes, child);
+    return path;
+}
 
-    while (pathnodes->size != 0) {
-        struct parse *node = list_remove_start(pathnodes);
+static void builder_token(void *ctx, const struct token *tk)
+{
+    struct an_builder *b = ctx;
+    struct an_process *proc = b->proc;
 
-        switch (node->type) {
-            case PROD_PIPELINE_TAIL:
-                {
-                    struct parse *node_child;
+    if (b->nomem)
+        return;
 
-                    node_child = node->lchild;
-                    while (node_child != NULL) {
-                        list_append(pathnodes, node_child);
-                        node_child = node_child->rsibling;
-                    }
-                }
-                break;
-            case PROD_TERMINAL:
-            case PROD_ARGLIST:
-                /* do nothing */
-                break;
-            case PROD_NAME:
-                {
-                    proc = get_process(node);
-                    list_append(pipeline->procs, proc);
-                }
-                break;
-            default:
-                /* TODO: error */
-                assert(0);
-                break;
-        }
+    if (tk->cat == CAT_AMPERSAND) {
+        b->pipeline->is_bg = true;
+        return;
     }
 
-    /* advance past <pipeline_tail> to <stdout_pipe> */
-    child = child->rsibling;
+    if (tk->cat == CAT_SEMICOLON || tk->cat == CAT_NEWLINE)
+        return;
 
-    if (!prstree_empty(child)) {
-        struct parse *child2;
+    /* the pipeline's source runs to the end of its latest token */
+    if (b->pipeline->source.data == NULL)
+        b->pipeline->source = tk->raw;
+    else
+        b->pipeline->source.len = tk->raw.data + tk->raw.len - b->pipeline->source.data;
 
-        /* this takes us to the <name> */
-        child2 = child->lchild->rsibling;
-        assert(child2->type == PROD_NAME);
-        /* this takes us to the terminal inside <name> */
-        child2 = child2->lchild;
+    if (tk->cat != CAT_ARG && tk->cat != CAT_PATH_ABS && tk->cat != CAT_PATH_REL
+            && tk->cat != CAT_STRING_DBL && tk->cat != CAT_STRING_SNGL)
+        return;
 
-        pipeline->file_out = calloc(1, sizeof(*pipeline->file_out));
-        pipeline->file_out->fname = strdup(child2->token->str_data);
-        pipeline->file_out->is_rel = 
-            child2->token->cat == CAT_PATH_REL || pipeline->file_out->fname[0] == '/';
+    switch (b->role) {
+        case ROLE_PROGNAME:
+            b->args_capacity = 4;
+            proc = arena_calloc(b->arena, 1, sizeof(*proc));
+            if (proc == NULL
+                    || (proc->progname.fname = span_str(b->arena, tk->text)) == NULL
+                    || (proc->args = arena_alloc(b->arena,
+                            b->args_capacity * sizeof(*proc->args))) == NULL) {
+                b->nomem = true;
+                return;
+            }
+            proc->progname.is_rel = tk->cat == CAT_PATH_REL || proc->progname.fname[0] == '/';
+
+            proc->args[0] = proc->progname.fname;
+            proc->args[1] = NULL;
+            proc->num_args = 2;
+
+            if (b->pipeline->procs->size == 0)
+                b->pipeline->lineno = tk->lineno;
+            if (list_append(b->pipeline->procs, proc) == -1) {
+                b->nomem = true;
+                return;
+            }
+            b->proc = proc;
+            break;
+        case ROLE_ARG:
+            if (proc->num_args == b->args_capacity) {
+                char **args = arena_realloc(b->arena, proc->args,
+                        b->args_capacity * sizeof(*proc->args),
+                        2 * b->args_capacity * sizeof(*proc->args));
+
+                if (args == NULL) {
+                    b->nomem = true;
+                    return;
+                }
+                proc->args = args;
+                b->args_capacity *= 2;
+            }
+            /* the new argument takes the place of the NULL terminator */
+            if ((proc->args[proc->num_args - 1] = span_str(b->arena, tk->text)) == NULL) {
+                b->nomem = true;
+                return;
+            }
+            proc->args[proc->num_args] = NULL;
+            proc->num_args++;
+            break;
+        case ROLE_FILE_IN:
+            if ((b->pipeline->file_in = builder_path(b, tk)) == NULL)
+                b->nomem = true;
+            break;
+        case ROLE_FILE_OUT:
+            if ((b->pipeline->file_out = builder_path(b, tk)) == NULL)
+                b->nomem = true;
+            break;
     }
-
-    /* advance to <amp_op> */
-    child = child->rsibling;
-
-    pipeline->is_bg = !prstree_empty(child);
-
-    /* cleanup */
-    list_destroy(pathnodes, NULL);
-
-    return pipeline;
 }
 
-struct llist *analyze_pipelines(struct parse *tree)
+struct llist *analyze_pipelines(struct arena *arena, struct parse *tree)
 {
-    struct llist *pipelines;
-    struct llist *pathnodes;
-
-    pipelines = list_new();
-    pathnodes = list_new();
+    struct an_builder b = {
+        .arena = arena,
+        .pipelines = list_new_arena(arena)
+    };
+    struct llist *pathnodes = list_new_arena(arena);
 
-    list_append(pathnodes, tree);
+    if (b.pipelines == NULL || pathnodes == NULL || list_prepend(pathnodes, tree) == -1)
+        return NULL;
 
-    while (pathnodes->size != 0) {
+    /**
+     * Walk the tree in preorder and replay it as the parser would
+     * have reported it, so that both paths build the same pipelines.
+     */
+    while (pathnodes->size != 0 && !b.nomem) {
         struct parse *node = list_remove_start(pathnodes);
 
-        switch (node->type) {
-            case PROD_PROGRAM:
-            case PROD_LINE:
-            case PROD_LINES_LIST:
-            case PROD_PLN_LIST:
-                {
-                    struct parse *child;
-
-                    child = node->lchild;
-                    while (child != NULL) {
-                        list_append(pathnodes, child);
-                        child = child->rsibling;
-                    }
-                }
-                break;
-            case PROD_PIPELINE:
-                {
-                    struct an_pipeline *pln;
+        if (node->rsibling != NULL && list_prepend(pathnodes, node->rsibling) == -1)
+            return NULL;
 
-                    pln = get_pipeline(node);
-                    list_append(pipelines, pln);
-                }
-                break;
-            case PROD_TERMINAL:
-                /* do nothing */
-                break;
-            default:
-                /* TODO: error */
-                assert(0);
-                break;
+        if (node->type == PROD_TERMINAL) {
+            builder_token(&b, node->token);
+        } else if (!prstree_empty(node)) {
+            builder_expand(&b, node->type);
+            if (list_prepend(pathnodes, node->lchild) == -1)
+                return NULL;
         }
     }
 
-    /* cleanup */
-    list_destroy(pathnodes, NULL);
-    
-    return pipelines;
+    return b.nomem ? NULL : b.pipelines;
+}
+
+struct llist *analyze_tokens(struct arena *arena, const struct llist *tokens,
+        struct parse_error **err_listp)
+{
+    static const struct parse_listener listener = {
+        .expand = builder_expand,
+        .token = builder_token
+    };
+    struct an_builder b = {
+        .arena = arena,
+        .pipelines = list_new_arena(arena)
+    };
+
+    if (b.pipelines == NULL || !rdparser_listen(arena, tokens, err_listp, &listener, &b))
+        return NULL;
+
+    return b.nomem ? NULL : b.pipelines;
 }
@@ -50,6 +50,16 @@ struct an_pipeline {
      */
     bool is_bg;
 
+    /**
+     * The line the pipeline starts on.
+     */
+    size_t lineno;
+
+    /**
+     * The text of the pipeline in the input, without a trailing '&'.
+     */
+    struct span source;
+
     /**
      * A list of {struct an_process}es. The contents of this list
      * are managed internally and should not be free()d.
@@ -58,13 +68,21 @@ struct an_pipeline {
 };
 
 /**
- * Frees all data allocated by a {struct an_pipeline}.
+ * Analyzes the syntax tree and returns a list of pipelines to execute.
+ * The pipelines are allocated from {@arena}, so they share the
+ * lifetime of the parse. Anything that must outlive it has to be
+ * copied out. Returns NULL if the arena runs out of memory.
  */
-void an_pipeline_destroy(struct an_pipeline *pipeline);
+struct llist *analyze_pipelines(struct arena *arena, struct parse *tree);
 
 /**
- * Analyzes the syntax tree and returns a list of pipelines to execute.
+ * Parses the tokens and builds the list of pipelines in the same
+ * pass, without an intermediate parse tree. Returns NULL if parsing
+ * failed, in which case *{@err_listp} will point to the errors, or if
+ * the arena ran out of memory, possibly without any errors.
+ * Like analyze_pipelines(), everything is allocated from {@arena}.
  */
-struct llist *analyze_pipelines(struct parse *tree);
+struct llist *analyze_tokens(struct arena *arena, const struct llist *tokens,
+        struct parse_error **err_listp);
 
 #endif
@@ -0,0 +1,138 @@
+#include "batch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/**
+ * What the kernel leaves out of ARG_MAX, as in POSIX's xargs.
+ */
+#define BATCH_HEADROOM 2048
+
+/**
+ * How long one argument may be (MAX_ARG_STRLEN in Linux).
+ */
+#define BATCH_MAX_STRLEN(page_size) (32 * (size_t) (page_size))
+
+/**
+ * What a string takes out of ARG_MAX: itself, and its pointer.
+ */
+static size_t arg_cost(const char *arg)
+{
+    return strlen(arg) + 1 + sizeof(char *);
+}
+
+/**
+ * How much of ARG_MAX is left for the arguments.
+ */
+static size_t batch_budget(void)
+{
+    long arg_max = sysconf(_SC_ARG_MAX);
+    size_t used = BATCH_HEADROOM + sizeof(char *);
+
+    for (char **env = environ; *env != NULL; ++env)
+        used += arg_cost(*env);
+
+    return arg_max > 0 && (size_t) arg_max > used ? arg_max - used : 0;
+}
+
+bool batch_fits(char *const argv[])
+{
+    size_t max_strlen = BATCH_MAX_STRLEN(sysconf(_SC_PAGESIZE));
+    size_t budget = batch_budget();
+    size_t cost = sizeof(char *);
+
+    for (char *const *arg = argv; *arg != NULL; ++arg) {
+        if (strlen(*arg) >= max_strlen)
+            return false;
+        cost += arg_cost(*arg);
+    }
+
+    return cost <= budget;
+}
+
+int batch_init(struct batch *b, char **argv, size_t max_args, size_t max_chars)
+{
+    size_t cost = sizeof(char *);
+
+    b->argv = argv;
+    b->argc = 0;
+    while (argv[b->argc] != NULL)
+        b->argc++;
+
+    /* the program, and anything up to a "--" after it */
+    b->num_fixed = 1;
+    for (size_t i = 1; i < b->argc; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            b->num_fixed = i + 1;
+            break;
+        }
+    }
+
+    b->next = b->num_fixed;
+    b->num_chunks = 0;
+    b->max_args = max_args;
+    b->budget = batch_budget();
+    if (max_chars != 0 && max_chars < b->budget)
+        b->budget = max_chars;
+
+    for (size_t i = 0; i < b->num_fixed; ++i)
+        cost += arg_cost(argv[i]);
+    if (b->argc == 0 || cost >= b->budget)
+        return -1;
+    b->budget -= cost;
+
+    return 0;
+}
+
+char **batch_next(struct batch *b)
+{
+    size_t max_strlen = BATCH_MAX_STRLEN(sysconf(_SC_PAGESIZE));
+    size_t cost = 0;
+    size_t end = b->next;
+    size_t argc;
+    size_t size;
+    char **chunk;
+    char *str;
+
+    /* a command with no arguments besides the fixed ones still runs once */
+    if (b->next == b->argc && b->num_chunks > 0)
+        return NULL;
+
+    while (end < b->argc && (b->max_args == 0 || end - b->next < b->max_args)) {
+        size_t len = strlen(b->argv[end]);
+
+        if (len >= max_strlen || cost + len + 1 + sizeof(char *) > b->budget)
+            break;
+        cost += len + 1 + sizeof(char *);
+        end++;
+    }
+
+    if (end == b->next && end < b->argc) {
+        errno = E2BIG;
+        return NULL;
+    }
+
+    argc = b->num_fixed + end - b->next;
+    size = (argc + 1) * sizeof(*chunk);
+    for (size_t i = 0; i < b->num_fixed; ++i)
+        size += strlen(b->argv[i]) + 1;
+    size += cost - (end - b->next) * sizeof(char *);
+
+    chunk = malloc(size);
+    str = (char *) (chunk + argc + 1);
+    for (size_t i = 0; i < argc; ++i) {
+        const char *arg = b->argv[i < b->num_fixed ? i : b->next + i - b->num_fixed];
+        size_t len = strlen(arg) + 1;
+
+        chunk[i] = memcpy(str, arg, len);
+        str += len;
+    }
+    chunk[argc] = NULL;
+
+    b->next = end;
+    b->num_chunks++;
+    return chunk;
+}
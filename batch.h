@@ -0,0 +1,59 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Splits a command with more arguments than one exec() takes into
+ * several commands, each with as many of the arguments as fit, the
+ * way xargs(1) would.
+ *
+ * The limit is ARG_MAX, which the arguments share with the environment,
+ * and each argument is also limited on its own. The program is repeated
+ * in every chunk, and so is everything up to and including the first
+ * "--" after it, if there is one: "grep -e pat -- files..." repeats
+ * "grep -e pat --". Options are not told apart from their values.
+ */
+struct batch {
+    /** The whole command, and how many arguments it has. **/
+    char **argv;
+    size_t argc;
+
+    /** How many of the arguments are repeated in every chunk. **/
+    size_t num_fixed;
+
+    /** The first argument that is not in a chunk yet. **/
+    size_t next;
+
+    /** How many chunks have been handed out. **/
+    size_t num_chunks;
+
+    /** The most arguments in a chunk, besides the fixed ones; 0 for any. **/
+    size_t max_args;
+
+    /** How many bytes of arguments a chunk may take. **/
+    size_t budget;
+};
+
+/**
+ * Whether the command {@argv} can be exec()d as it is.
+ */
+bool batch_fits(char *const argv[]);
+
+/**
+ * Starts splitting {@argv}, with at most {@max_args} arguments and
+ * {@max_chars} bytes per chunk, if they are not 0. Returns -1 if not
+ * even the fixed arguments fit.
+ */
+int batch_init(struct batch *b, char **argv, size_t max_args, size_t max_chars);
+
+/**
+ * Returns the next chunk, as a NULL-terminated array of strings in one
+ * allocation with the strings, like a struct proc's argv. Returns NULL
+ * when there is nothing left, or with errno set to E2BIG when the next
+ * argument does not fit on its own.
+ */
+char **batch_next(struct batch *b);
+
+#endif
@@ -0,0 +1,39 @@
+#!/bin/sh
+# usage: bench/startup.sh [runs] [shell...]
+#
+# Times how long each shell takes to start, run a command line given
+# with -c, and exit, averaged over a number of runs. The commands do
+# next to nothing, so what is measured is the shell. "exec" is the
+# command run without a shell, for how much of it is not the shell's.
+# The shells default to ./shell and dash.
+
+runs=${1:-1000}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] || set -- ./shell dash
+
+# microseconds per run of "$@"
+per_run()
+{
+    start=$(date +%s%N)
+    i=0
+    while [ $i -lt "$runs" ]; do
+        "$@" </dev/null >/dev/null
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+    echo $(( (end - start) / runs / 1000 ))
+}
+
+printf '%-12s %10s %10s %10s\n' shell '1 cmd' '2 cmds' 'pipeline'
+printf '%-12s %9sus %10s %10s\n' exec "$(per_run /bin/true)" - -
+
+for sh in "$@"; do
+    if ! command -v "$sh" >/dev/null 2>&1; then
+        echo "$sh: not found, skipped" >&2
+        continue
+    fi
+    printf '%-12s %9sus %9sus %9sus\n' "$(basename "$sh")" \
+        "$(per_run "$sh" -c '/bin/true')" \
+        "$(per_run "$sh" -c '/bin/true; /bin/true')" \
+        "$(per_run "$sh" -c '/bin/echo x | /bin/cat')"
+done
@@ -0,0 +1,340 @@
+#include "check.h"
+#include "pcfsh.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * How much of a file is parsed at once. A chunk is
+ * extended to the end of the line it stops in.
+ */
+#define CHECK_CHUNK (256 * 1024)
+
+struct check_file {
+    const char *path;
+    /**
+     * What is reported about the file, printed once all files are checked,
+     * so that the reports come out in order.
+     */
+    char *report;
+    size_t report_len;
+    size_t num_lines;
+    size_t num_errors;
+    /**
+     * The errno if the file could not be read, or 0.
+     */
+    int read_errno;
+};
+
+struct check {
+    pthread_mutex_t lock;
+    struct check_file *files;
+    size_t num_files;
+    /** The next file to be checked. **/
+    size_t next;
+    bool json;
+};
+
+/**
+ * Returns the length of the UTF-8 sequence at {@s}, or 0 if it is not
+ * valid: cut short, longer than it needs to be, a surrogate, or past
+ * U+10FFFF.
+ */
+static size_t utf8_len(const unsigned char *s)
+{
+    unsigned int cp;
+    unsigned int min;
+    size_t len;
+
+    if (s[0] < 0x80) {
+        return 1;
+    } else if ((s[0] & 0xe0) == 0xc0) {
+        cp = s[0] & 0x1f;
+        min = 0x80;
+        len = 2;
+    } else if ((s[0] & 0xf0) == 0xe0) {
+        cp = s[0] & 0x0f;
+        min = 0x800;
+        len = 3;
+    } else if ((s[0] & 0xf8) == 0xf0) {
+        cp = s[0] & 0x07;
+        min = 0x10000;
+        len = 4;
+    } else {
+        return 0;
+    }
+
+    /* this stops at the NUL as well */
+    for (size_t i = 1; i < len; ++i) {
+        if ((s[i] & 0xc0) != 0x80)
+            return 0;
+        cp = cp << 6 | (s[i] & 0x3f);
+    }
+
+    if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff))
+        return 0;
+    return len;
+}
+
+/**
+ * Writes {@str} as a JSON string. JSON has to be UTF-8, so any byte
+ * that is not part of a valid sequence becomes U+FFFD.
+ */
+static void json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    while (*str != '\0') {
+        unsigned char c = *str;
+        size_t len = utf8_len((const unsigned char *) str);
+
+        if (len == 0) {
+            fputs("\\ufffd", out);
+            len = 1;
+        } else if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fwrite(str, 1, len, out);
+        }
+        str += len;
+    }
+    fputc('"', out);
+}
+
+static void report_errors(struct check *chk, struct check_file *file, FILE *out,
+        const struct parse_error *err)
+{
+    for (; err != NULL; err = err->next) {
+        file->num_errors++;
+
+        if (chk->json) {
+            fputs("{\"type\":\"error\",\"file\":", out);
+            json_string(out, file->path);
+            fprintf(out, ",\"line\":%zu,\"column\":%zu,\"message\":", err->lineno, err->charno + 1);
+            json_string(out, err->message);
+            fputs("}\n", out);
+        } else {
+            fprintf(out, "%s:%zu:%zu: %s\n", file->path, err->lineno, err->charno + 1, err->message);
+        }
+    }
+}
+
+/**
+ * Parses the text from {@begin} to {@end} in chunks of whole lines.
+ * Like the shell does before running them, a chunk with errors is
+ * parsed again line by line, so that every bad line is found.
+ */
+static void check_text(struct check *chk, struct check_file *file, FILE *out,
+        struct pcfsh_context *ctx, const char *begin, const char *end)
+{
+    ctx->num_lines = 0;
+
+    while (begin < end) {
+        const char *chunk_end = end;
+        struct parse_error *err = NULL;
+        size_t lines_before = ctx->num_lines;
+
+        if (end - begin > CHECK_CHUNK) {
+            const char *nl = memchr(begin + CHECK_CHUNK, '\n', end - (begin + CHECK_CHUNK));
+
+            chunk_end = nl != NULL ? nl + 1 : end;
+        }
+
+        pcfsh_parse_text(ctx, begin, chunk_end, &err);
+        pcfsh_context_reset(ctx);
+
+        if (err != NULL) {
+            ctx->num_lines = lines_before;
+
+            while (begin < chunk_end) {
+                const char *nl = memchr(begin, '\n', chunk_end - begin);
+                const char *line_end = nl != NULL ? nl + 1 : chunk_end;
+
+                err = NULL;
+                pcfsh_parse_text(ctx, begin, line_end, &err);
+                report_errors(chk, file, out, err);
+                pcfsh_context_reset(ctx);
+                begin = line_end;
+            }
+        }
+
+        begin = chunk_end;
+    }
+
+    file->num_lines = ctx->num_lines;
+}
+
+/**
+ * Reads all of {@fd} into a buffer, for input that cannot be mapped.
+ */
+static char *read_all(int fd, size_t *lenp)
+{
+    size_t capacity = CHECK_CHUNK;
+    size_t len = 0;
+    char *buf = malloc(capacity);
+    ssize_t n;
+
+    while (buf != NULL && (n = read(fd, buf + len, capacity - len)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            free(buf);
+            return NULL;
+        }
+        len += n;
+        if (len == capacity) {
+            char *grown = realloc(buf, capacity * 2);
+
+            if (grown == NULL) {
+                free(buf);
+                return NULL;
+            }
+            buf = grown;
+            capacity *= 2;
+        }
+    }
+
+    *lenp = len;
+    return buf;
+}
+
+static void check_file(struct check *chk, struct check_file *file, struct pcfsh_context *ctx)
+{
+    FILE *out = open_memstream(&file->report, &file->report_len);
+    char *text = NULL;
+    size_t len = 0;
+    bool mapped = false;
+    struct stat st;
+    int fd;
+
+    if (strcmp(file->path, "-") == 0)
+        fd = STDIN_FILENO;
+    else if ((fd = open(file->path, O_RDONLY | O_CLOEXEC)) == -1)
+        file->read_errno = errno;
+
+    if (fd != -1) {
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            len = st.st_size;
+            text = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            mapped = text != MAP_FAILED;
+            if (mapped)
+                madvise(text, len, MADV_SEQUENTIAL);
+            else
+                text = NULL;
+        }
+        if (!mapped && (text = read_all(fd, &len)) == NULL)
+            file->read_errno = errno;
+        if (fd != STDIN_FILENO)
+            close(fd);
+    }
+
+    if (text != NULL)
+        check_text(chk, file, out, ctx, text, text + len);
+
+    if (chk->json) {
+        fputs("{\"type\":\"file\",\"file\":", out);
+        json_string(out, file->path);
+        if (file->read_errno != 0) {
+            fputs(",\"error\":", out);
+            json_string(out, strerror(file->read_errno));
+        } else {
+            fprintf(out, ",\"lines\":%zu,\"errors\":%zu", file->num_lines, file->num_errors);
+        }
+        fputs("}\n", out);
+    } else if (file->read_errno != 0) {
+        fprintf(out, "%s: %s\n", file->path, strerror(file->read_errno));
+    }
+
+    if (mapped)
+        munmap(text, len);
+    else
+        free(text);
+    fclose(out);
+}
+
+static void *check_thread(void *arg)
+{
+    struct check *chk = arg;
+    struct pcfsh_context ctx;
+
+    pcfsh_context_init(&ctx, NULL);
+
+    for (;;) {
+        struct check_file *file;
+
+        pthread_mutex_lock(&chk->lock);
+        file = chk->next < chk->num_files ? &chk->files[chk->next++] : NULL;
+        pthread_mutex_unlock(&chk->lock);
+
+        if (file == NULL)
+            break;
+        check_file(chk, file, &ctx);
+    }
+
+    pcfsh_context_destroy(&ctx);
+    return NULL;
+}
+
+int check_files(char *const paths[], size_t num_paths, size_t num_threads, bool json)
+{
+    static char *const stdin_path[] = { "-" };
+    struct check chk = { .json = json };
+    pthread_t *threads;
+    sigset_t all, mask;
+    size_t started = 0;
+    int status = 0;
+
+    if (num_paths == 0) {
+        paths = stdin_path;
+        num_paths = 1;
+    }
+
+    pthread_mutex_init(&chk.lock, NULL);
+    chk.num_files = num_paths;
+    chk.files = calloc(num_paths, sizeof(*chk.files));
+    if (num_threads > num_paths)
+        num_threads = num_paths;
+    threads = calloc(num_threads, sizeof(*threads));
+    if (chk.files == NULL || threads == NULL) {
+        perror("calloc()");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < num_paths; ++i)
+        chk.files[i].path = paths[i];
+
+    /* this thread checks files too, so it counts as one; it alone takes signals */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &mask);
+    for (size_t i = 1; i < num_threads; ++i) {
+        if (pthread_create(&threads[started], NULL, check_thread, &chk) != 0)
+            break;
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+    check_thread(&chk);
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    for (size_t i = 0; i < num_paths; ++i) {
+        struct check_file *file = &chk.files[i];
+
+        fwrite(file->report, 1, file->report_len, stdout);
+        free(file->report);
+        if (file->num_errors != 0 || file->read_errno != 0)
+            status = -1;
+    }
+
+    pthread_mutex_destroy(&chk.lock);
+    free(threads);
+    free(chk.files);
+    return status;
+}
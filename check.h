@@ -0,0 +1,16 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Checks the syntax of the scripts at {@paths}, without running
+ * anything. "-" is standard input. The files are checked on up to
+ * {@num_threads} threads, and every error is reported on stdout as
+ * "file:line:column: message", or as a JSON object per line if
+ * {@json} is set. Returns 0 if every file could be read and parsed.
+ */
+int check_files(char *const paths[], size_t num_paths, size_t num_threads, bool json);
+
+#endif
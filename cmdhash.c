@@ -0,0 +1,167 @@
+#define _GNU_SOURCE
+#include "cmdhash.h"
+#include "ds/htable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct cmdhash_entry {
+    char *name;
+    char *path;
+    /** How many times the command was looked up. **/
+    unsigned hits;
+};
+
+/**
+ * Maps names to {struct cmdhash_entry}s.
+ */
+static struct htable *table;
+
+/**
+ * The PATH that the commands in the table were found in.
+ */
+static char *table_path;
+
+static void entry_destroy(void *data)
+{
+    struct cmdhash_entry *entry = data;
+
+    free(entry->name);
+    free(entry->path);
+    free(entry);
+}
+
+/**
+ * Returns PATH, forgetting everything if it is not what it was.
+ */
+static const char *cmdhash_path(void)
+{
+    const char *path = getenv("PATH");
+
+    /* this is what execvp() searches without a PATH */
+    if (path == NULL)
+        path = "/bin:/usr/bin";
+
+    if (table == NULL)
+        table = htable_new(htable_str_hash, htable_str_equals);
+
+    if (table_path == NULL || strcmp(table_path, path) != 0) {
+        htable_clear(table, entry_destroy);
+        free(table_path);
+        table_path = strdup(path);
+    }
+
+    return path;
+}
+
+static struct cmdhash_entry *cmdhash_put(const char *name, const char *path)
+{
+    struct cmdhash_entry *entry = calloc(1, sizeof(*entry));
+    struct cmdhash_entry *old;
+
+    entry->name = strdup(name);
+    entry->path = strdup(path);
+    if ((old = htable_put(table, entry->name, entry)) != NULL)
+        entry_destroy(old);
+
+    return entry;
+}
+
+const char *cmdhash_lookup(const char *name)
+{
+    /* programs in directories that are relative to the cwd are not remembered */
+    static char relative[PATH_MAX];
+    char buf[PATH_MAX];
+    struct cmdhash_entry *entry;
+    const char *dir;
+    int error = ENOENT;
+
+    if (strchr(name, '/') != NULL)
+        return name;
+
+    dir = cmdhash_path();
+    if (*name == '\0') {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    if ((entry = htable_get(table, name)) != NULL) {
+        entry->hits++;
+        return entry->path;
+    }
+
+    /* search PATH the way execvp() does; an empty entry is the cwd */
+    for (;;) {
+        const char *end = strchrnul(dir, ':');
+        int len = end != dir ? end - dir : 1;
+        struct stat st;
+
+        snprintf(buf, sizeof(buf), "%.*s/%s", len, end != dir ? dir : ".", name);
+
+        if (stat(buf, &st) == 0 && S_ISREG(st.st_mode)) {
+            if (access(buf, X_OK) == 0) {
+                if (buf[0] != '/') {
+                    strcpy(relative, buf);
+                    return relative;
+                }
+                entry = cmdhash_put(name, buf);
+                entry->hits++;
+                return entry->path;
+            }
+            error = EACCES;
+        }
+
+        if (*end == '\0')
+            break;
+        dir = end + 1;
+    }
+
+    errno = error;
+    return NULL;
+}
+
+void cmdhash_set(const char *name, const char *path)
+{
+    cmdhash_path();
+    cmdhash_put(name, path);
+}
+
+void cmdhash_forget(const char *name)
+{
+    if (table != NULL) {
+        struct cmdhash_entry *entry = htable_remove(table, name);
+
+        if (entry != NULL)
+            entry_destroy(entry);
+    }
+}
+
+void cmdhash_clear(void)
+{
+    if (table != NULL)
+        htable_clear(table, entry_destroy);
+}
+
+static void cmdhash_list_entry(const void *key, void *value, void *ctx)
+{
+    const struct cmdhash_entry *entry = value;
+
+    dprintf(*(int *) ctx, "%4u\t%s\n", entry->hits, entry->path);
+}
+
+void cmdhash_list(int fd)
+{
+    cmdhash_path();
+
+    if (table->size == 0) {
+        dprintf(fd, "hash: hash table empty\n");
+        return;
+    }
+
+    dprintf(fd, "hits\tcommand\n");
+    htable_foreach(table, cmdhash_list_entry, &fd);
+}
@@ -0,0 +1,38 @@
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+/**
+ * Remembers where in PATH each command was found, so that PATH is only
+ * searched the first time a command is run. Everything is forgotten
+ * when PATH changes.
+ */
+
+/**
+ * Finds the program that {@name} runs. A name with a slash in it is
+ * returned as is. Otherwise, returns the path of the program, which
+ * stays valid until the table changes, or NULL with errno set if
+ * there is no such program in PATH.
+ */
+const char *cmdhash_lookup(const char *name);
+
+/**
+ * Makes {@name} run {@path}, whether it is in PATH or not.
+ */
+void cmdhash_set(const char *name, const char *path);
+
+/**
+ * Forgets where {@name} is, e.g. because it was not there anymore.
+ */
+void cmdhash_forget(const char *name);
+
+/**
+ * Forgets everything.
+ */
+void cmdhash_clear(void);
+
+/**
+ * Writes the table to {@fd}, with how many times each command was looked up.
+ */
+void cmdhash_list(int fd);
+
+#endif
@@ -0,0 +1,187 @@
+#include "arena.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_DEFAULT_CHUNK (64 * 1024)
+#define ARENA_ALIGN (_Alignof(max_align_t))
+
+static inline size_t align_up(size_t n)
+{
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static void *default_alloc(void *ctx, size_t size)
+{
+    return malloc(size);
+}
+
+static void default_free(void *ctx, void *ptr, size_t size)
+{
+    free(ptr);
+}
+
+static const struct arena_allocator default_allocator = {
+    .alloc = default_alloc,
+    .free = default_free
+};
+
+static struct arena_chunk *chunk_new(struct arena *arena, size_t size)
+{
+    struct arena_chunk *chunk = NULL;
+
+    if (size <= SIZE_MAX - sizeof(*chunk))
+        chunk = arena->allocator.alloc(arena->allocator.ctx, sizeof(*chunk) + size);
+    if (chunk == NULL) {
+        /* the allocator may not say why */
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+
+    return chunk;
+}
+
+void arena_init(struct arena *arena, size_t chunk_size)
+{
+    arena_init_allocator(arena, chunk_size, NULL);
+}
+
+void arena_init_allocator(struct arena *arena, size_t chunk_size,
+        const struct arena_allocator *allocator)
+{
+    arena->head = NULL;
+    arena->cur = NULL;
+    arena->chunk_size = chunk_size != 0 ? chunk_size : ARENA_DEFAULT_CHUNK;
+    arena->last = NULL;
+    arena->allocator = allocator != NULL ? *allocator : default_allocator;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    struct arena_chunk *chunk = arena->cur;
+    void *ptr;
+
+    if (size > SIZE_MAX - ARENA_ALIGN) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size = align_up(size);
+
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        /* try to reuse the next chunk, which was kept from before a reset */
+        if (chunk != NULL && chunk->next != NULL && chunk->next->size >= size) {
+            chunk = chunk->next;
+            chunk->used = 0;
+        } else {
+            struct arena_chunk *fresh;
+
+            fresh = chunk_new(arena, size > arena->chunk_size ? size : arena->chunk_size);
+            if (fresh == NULL)
+                return NULL;
+            if (chunk == NULL) {
+                arena->head = fresh;
+            } else {
+                fresh->next = chunk->next;
+                chunk->next = fresh;
+            }
+            chunk = fresh;
+        }
+        arena->cur = chunk;
+    }
+
+    ptr = (char *) chunk->data + chunk->used;
+    chunk->used += size;
+    arena->last = ptr;
+
+    return ptr;
+}
+
+void *arena_calloc(struct arena *arena, size_t nmemb, size_t size)
+{
+    void *ptr;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ptr = arena_alloc(arena, nmemb * size);
+    if (ptr != NULL)
+        memset(ptr, 0, nmemb * size);
+    return ptr;
+}
+
+void *arena_realloc(struct arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    void *fresh;
+
+    if (ptr == NULL)
+        return arena_alloc(arena, new_size);
+
+    if (ptr == arena->last && new_size <= SIZE_MAX - ARENA_ALIGN) {
+        struct arena_chunk *chunk = arena->cur;
+        size_t offset = (char *) ptr - (char *) chunk->data;
+
+        if (chunk->size - offset >= align_up(new_size)) {
+            chunk->used = offset + align_up(new_size);
+            return ptr;
+        }
+    }
+
+    if (new_size <= old_size)
+        return ptr;
+
+    fresh = arena_alloc(arena, new_size);
+    if (fresh != NULL)
+        memcpy(fresh, ptr, old_size);
+
+    return fresh;
+}
+
+char *arena_strdup(struct arena *arena, const char *str)
+{
+    return arena_strndup(arena, str, strlen(str));
+}
+
+char *arena_strndup(struct arena *arena, const char *str, size_t len)
+{
+    char *copy;
+
+    len = strnlen(str, len);
+    copy = arena_alloc(arena, len + 1);
+    if (copy == NULL)
+        return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+
+    return copy;
+}
+
+void arena_reset(struct arena *arena)
+{
+    arena->cur = arena->head;
+    if (arena->cur != NULL)
+        arena->cur->used = 0;
+    arena->last = NULL;
+}
+
+void arena_destroy(struct arena *arena)
+{
+    struct arena_chunk *chunk = arena->head;
+
+    while (chunk != NULL) {
+        struct arena_chunk *next = chunk->next;
+
+        arena->allocator.free(arena->allocator.ctx, chunk, sizeof(*chunk) + chunk->size);
+        chunk = next;
+    }
+
+    arena->head = NULL;
+    arena->cur = NULL;
+    arena->last = NULL;
+}
@@ -0,0 +1,114 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * A bump allocator. Objects are carved out of large chunks and
+ * are never freed individually; instead, the whole arena is
+ * reset (or destroyed) at once.
+ */
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    /**
+     * Usable bytes in {@data}.
+     */
+    size_t size;
+    /**
+     * Bytes handed out so far.
+     */
+    size_t used;
+    max_align_t data[];
+};
+
+/**
+ * Where an arena gets its chunks from. {@free} is passed the
+ * same size that was passed to {@alloc} for the chunk.
+ * {@alloc} may return NULL if it is out of memory.
+ */
+struct arena_allocator {
+    void *(*alloc)(void *ctx, size_t size);
+    void (*free)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+};
+
+struct arena {
+    /**
+     * The first chunk. Chunks are kept around between resets.
+     */
+    struct arena_chunk *head;
+    /**
+     * The chunk we are currently allocating from.
+     */
+    struct arena_chunk *cur;
+    /**
+     * The default size of a new chunk.
+     */
+    size_t chunk_size;
+    /**
+     * The most recent allocation, so that it can be grown in place.
+     */
+    void *last;
+    /**
+     * Where the chunks come from.
+     */
+    struct arena_allocator allocator;
+};
+
+/**
+ * Initializes an empty arena. If {@chunk_size} is 0, a default is used.
+ */
+void arena_init(struct arena *arena, size_t chunk_size);
+
+/**
+ * Like arena_init(), but the chunks are allocated with {@allocator}
+ * instead of malloc(3). If {@allocator} is NULL, malloc(3) is used.
+ */
+void arena_init_allocator(struct arena *arena, size_t chunk_size,
+        const struct arena_allocator *allocator);
+
+/**
+ * Returns {@size} bytes of uninitialized storage, suitably
+ * aligned for any object. Returns NULL, with errno set to ENOMEM,
+ * if the allocator is out of memory.
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * Like arena_alloc(), but the storage is zeroed. Returns NULL as well
+ * if {@nmemb} * {@size} overflows.
+ */
+void *arena_calloc(struct arena *arena, size_t nmemb, size_t size);
+
+/**
+ * Grows (or shrinks) {@ptr}, which must have been allocated from
+ * {@arena} with {@old_size} bytes. If {@ptr} was the most recent
+ * allocation, this happens in place when possible. Returns NULL if
+ * it has to move and there is no memory, leaving {@ptr} as it was.
+ */
+void *arena_realloc(struct arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * Copies a NUL-terminated string into the arena. Returns NULL if
+ * there is no memory for it.
+ */
+char *arena_strdup(struct arena *arena, const char *str);
+
+/**
+ * Copies at most {@len} bytes of {@str} into the arena and NUL-terminates it.
+ */
+char *arena_strndup(struct arena *arena, const char *str, size_t len);
+
+/**
+ * Releases every allocation at once in O(1). The chunks are kept
+ * for reuse.
+ */
+void arena_reset(struct arena *arena);
+
+/**
+ * Frees all chunks owned by the arena.
+ */
+void arena_destroy(struct arena *arena);
+
+#endif
@@ -0,0 +1,176 @@
+#include "htable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HTABLE_MIN_BUCKETS 16
+
+static void *htable_calloc(size_t nmemb, size_t size)
+{
+    void *ptr = calloc(nmemb, size);
+
+    if (ptr == NULL) {
+        perror("htable");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+struct htable *htable_new(size_t (*hash)(const void *key),
+        bool (*equals)(const void *key1, const void *key2))
+{
+    struct htable *table = htable_calloc(1, sizeof(*table));
+
+    table->num_buckets = HTABLE_MIN_BUCKETS;
+    table->buckets = htable_calloc(table->num_buckets, sizeof(*table->buckets));
+    table->hash = hash;
+    table->equals = equals;
+
+    return table;
+}
+
+/**
+ * Returns the link that points to the entry for {@key},
+ * or to where it would go (at the end of its chain).
+ */
+static struct htable_entry **htable_find(const struct htable *table, const void *key, size_t hash)
+{
+    struct htable_entry **entryp = &table->buckets[hash & (table->num_buckets - 1)];
+
+    while (*entryp != NULL
+            && ((*entryp)->hash != hash || !table->equals((*entryp)->key, key)))
+        entryp = &(*entryp)->next;
+
+    return entryp;
+}
+
+/**
+ * Doubles the number of buckets, keeping the chains short.
+ */
+static void htable_grow(struct htable *table)
+{
+    size_t num_buckets = table->num_buckets * 2;
+    struct htable_entry **buckets = htable_calloc(num_buckets, sizeof(*buckets));
+
+    for (size_t i = 0; i < table->num_buckets; ++i) {
+        struct htable_entry *entry = table->buckets[i];
+
+        while (entry != NULL) {
+            struct htable_entry *next = entry->next;
+            struct htable_entry **bucket = &buckets[entry->hash & (num_buckets - 1)];
+
+            entry->next = *bucket;
+            *bucket = entry;
+            entry = next;
+        }
+    }
+
+    free(table->buckets);
+    table->buckets = buckets;
+    table->num_buckets = num_buckets;
+}
+
+void *htable_get(const struct htable *table, const void *key)
+{
+    struct htable_entry *entry = *htable_find(table, key, table->hash(key));
+
+    return entry != NULL ? entry->value : NULL;
+}
+
+void *htable_put(struct htable *table, const void *key, void *value)
+{
+    size_t hash = table->hash(key);
+    struct htable_entry **entryp = htable_find(table, key, hash);
+    void *old_value;
+
+    if (*entryp != NULL) {
+        old_value = (*entryp)->value;
+        (*entryp)->key = key;
+        (*entryp)->value = value;
+        return old_value;
+    }
+
+    *entryp = htable_calloc(1, sizeof(**entryp));
+    (*entryp)->key = key;
+    (*entryp)->value = value;
+    (*entryp)->hash = hash;
+    table->size++;
+
+    /* keep the load factor under 3/4 */
+    if (table->size * 4 > table->num_buckets * 3)
+        htable_grow(table);
+
+    return NULL;
+}
+
+void *htable_remove(struct htable *table, const void *key)
+{
+    struct htable_entry **entryp = htable_find(table, key, table->hash(key));
+    struct htable_entry *entry = *entryp;
+    void *value;
+
+    if (entry == NULL)
+        return NULL;
+
+    value = entry->value;
+    *entryp = entry->next;
+    free(entry);
+    table->size--;
+
+    return value;
+}
+
+void htable_foreach(const struct htable *table,
+        void (*func)(const void *key, void *value, void *ctx), void *ctx)
+{
+    for (size_t i = 0; i < table->num_buckets; ++i)
+        for (struct htable_entry *entry = table->buckets[i]; entry != NULL; entry = entry->next)
+            func(entry->key, entry->value, ctx);
+}
+
+void htable_clear(struct htable *table, void (*dtor_func)(void *))
+{
+    for (size_t i = 0; i < table->num_buckets; ++i) {
+        struct htable_entry *entry = table->buckets[i];
+
+        while (entry != NULL) {
+            struct htable_entry *next = entry->next;
+
+            if (dtor_func != NULL)
+                dtor_func(entry->value);
+            free(entry);
+            entry = next;
+        }
+        table->buckets[i] = NULL;
+    }
+
+    table->size = 0;
+}
+
+void htable_destroy(struct htable *table, void (*dtor_func)(void *))
+{
+    if (table == NULL)
+        return;
+
+    htable_clear(table, dtor_func);
+    free(table->buckets);
+    free(table);
+}
+
+size_t htable_str_hash(const void *key)
+{
+    /* FNV-1a */
+    size_t hash = 14695981039346656037ULL;
+
+    for (const unsigned char *p = key; *p != '\0'; ++p) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+bool htable_str_equals(const void *key1, const void *key2)
+{
+    return strcmp(key1, key2) == 0;
+}
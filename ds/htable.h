@@ -0,0 +1,78 @@
+#ifndef HTABLE_H
+#define HTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A hash table with separate chaining. Keys and values are pointers
+ * owned by the caller; the table only compares keys with the
+ * functions it was created with.
+ */
+
+struct htable_entry {
+    const void *key;
+    void *value;
+    size_t hash;
+    struct htable_entry *next;
+};
+
+struct htable {
+    struct htable_entry **buckets;
+    /**
+     * Always a power of two.
+     */
+    size_t num_buckets;
+    size_t size;
+    size_t (*hash)(const void *key);
+    bool (*equals)(const void *key1, const void *key2);
+};
+
+/**
+ * Creates an empty table that uses {@hash} and {@equals} on its keys.
+ */
+struct htable *htable_new(size_t (*hash)(const void *key),
+        bool (*equals)(const void *key1, const void *key2));
+
+/**
+ * Returns the value for {@key}, or NULL if there is none.
+ */
+void *htable_get(const struct htable *table, const void *key);
+
+/**
+ * Sets the value for {@key}, which must stay valid while it is in
+ * the table. Returns the value it replaced, or NULL.
+ */
+void *htable_put(struct htable *table, const void *key, void *value);
+
+/**
+ * Removes {@key} from the table. Returns its value, or NULL.
+ */
+void *htable_remove(struct htable *table, const void *key);
+
+/**
+ * Calls {@func} on each key and value, in no particular order.
+ * {@func} must not change the table.
+ */
+void htable_foreach(const struct htable *table,
+        void (*func)(const void *key, void *value, void *ctx), void *ctx);
+
+/**
+ * Removes everything from the table, calling {@dtor_func}
+ * on each value if it is not NULL.
+ */
+void htable_clear(struct htable *table, void (*dtor_func)(void *));
+
+/**
+ * Like htable_clear(), but also frees the table.
+ * Returns if {@table} is NULL.
+ */
+void htable_destroy(struct htable *table, void (*dtor_func)(void *));
+
+/**
+ * For tables keyed by NUL-terminated strings.
+ */
+size_t htable_str_hash(const void *key);
+bool htable_str_equals(const void *key1, const void *key2);
+
+#endif
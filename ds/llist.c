@@ -7,38 +7,70 @@ struct llist *list_new(void)
     return calloc(1, sizeof(struct llist));
 }
 
-void list_append(struct llist *list, void *data)
+struct llist *list_new_arena(struct arena *arena)
 {
+    struct llist *list = arena_calloc(arena, 1, sizeof(struct llist));
+
+    if (list != NULL)
+        list->arena = arena;
+    return list;
+}
+
+static struct link *link_new(struct llist *list)
+{
+    if (list->arena != NULL)
+        return arena_calloc(list->arena, 1, sizeof(struct link));
+    return calloc(1, sizeof(struct link));
+}
+
+static void link_free(struct llist *list, struct link *link)
+{
+    if (list->arena == NULL)
+        free(link);
+}
+
+int list_append(struct llist *list, void *data)
+{
+    struct link *link = link_new(list);
+
+    if (link == NULL)
+        return -1;
+    link->data = data;
+
     if (list->head == NULL) {
-        list->head = calloc(1, sizeof(struct link));
-        list->head->data = data;
+        list->head = link;
         list->last = list->head;
     } else {
         struct link *last = list->last;
-        list->last = calloc(1, sizeof(struct link));
-        list->last->data = data;
+        list->last = link;
         list->last->prev = last;
         last->next = list->last;
     }
 
     list->size++;
+    return 0;
 }
 
-void list_prepend(struct llist *list, void *data)
+int list_prepend(struct llist *list, void *data)
 {
+    struct link *link = link_new(list);
+
+    if (link == NULL)
+        return -1;
+    link->data = data;
+
     if (list->head == NULL) {
-        list->head = calloc(1, sizeof(struct link));
-        list->head->data = data;
+        list->head = link;
         list->last = list->head;
     } else {
         struct link *head = list->head;
-        list->head = calloc(1, sizeof(struct link));
-        list->head->data = data;
+        list->head = link;
         list->head->next = head;
         head->prev = list->head;
     }
 
     list->size++;
+    return 0;
 }
 
 void *list_remove_end(struct llist *list)
@@ -49,7 +81,7 @@ void *list_remove_end(struct llist *list)
 
     if (list->head == list->last) {
         data = list->last->data;
-        free(list->last);
+        link_free(list, list->last);
         list->head = NULL;
         list->last = NULL;
     } else {
@@ -57,7 +89,7 @@ void *list_remove_end(struct llist *list)
         data = last->data;
         list->last = last->prev;
         list->last->next = NULL;
-        free(last);
+        link_free(list, last);
     }
 
     list->size--;
@@ -72,7 +104,7 @@ void *list_remove_start(struct llist *list)
 
     if (list->head == list->last) {
         data = list->head->data;
-        free(list->head);
+        link_free(list, list->head);
         list->head = NULL;
         list->last = NULL;
     } else {
@@ -80,7 +112,7 @@ void *list_remove_start(struct llist *list)
         data = list->head->data;
         list->head = head->next;
         list->head->prev = NULL;
-        free(head);
+        link_free(list, head);
     }
 
     list->size--;
@@ -101,8 +133,9 @@ void list_destroy(struct llist *list, void (*dtor_func)(void *))
             (*dtor_func)(link->data);
         oldlnk = link;
         link = oldlnk->next;
-        free(oldlnk);
+        link_free(list, oldlnk);
     }
 
-    free(list);
+    if (list->arena == NULL)
+        free(list);
 }
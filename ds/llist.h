@@ -2,6 +2,7 @@
 #define LLIST_H
 
 #include <stddef.h>
+#include "arena.h"
 
 struct link {
     void *data;
@@ -13,6 +14,11 @@ struct llist {
     size_t size;
     struct link *head;
     struct link *last;
+    /**
+     * If non-NULL, the list and its links live in this arena
+     * and are never freed individually.
+     */
+    struct arena *arena;
 };
 
 /**
@@ -20,15 +26,24 @@ struct llist {
  */
 struct llist *list_new(void);
 
+/**
+ * Creates an empty list whose storage comes from {@arena}.
+ * Such a list goes away when the arena is reset.
+ * Returns NULL if the arena is out of memory.
+ */
+struct llist *list_new_arena(struct arena *arena);
+
 /**
  * Inserts {@data} at the end of the list.
+ * Returns -1 if there is no memory for it.
  */
-void list_append(struct llist *list, void *data);
+int list_append(struct llist *list, void *data);
 
 /**
  * Inserts {@data} at the beginning of the list.
+ * Returns -1 if there is no memory for it.
  */
-void list_prepend(struct llist *list, void *data);
+int list_prepend(struct llist *list, void *data);
 
 /**
  * Remove the last element of the list and return it.
@@ -44,6 +59,7 @@ void *list_remove_start(struct llist *list);
  * free every element in this list and call a destructor function,
  * {@dtor_func} on each record if {@dtor_func} != NULL.
  * Returns if {@list} is NULL.
+ * For arena lists, only the destructor is run.
  */
 void list_destroy(struct llist *list, void (*dtor_func)(void *));
 
@@ -1,62 +1,540 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include "parser.h"
-#include "analyzer.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include "pcfsh.h"
 #include "shell.h"
+#include "reader.h"
+#include "pparser.h"
+#include "check.h"
 
-int main(int argc, char *argv[])
+/**
+ * How much of a script is tokenized at once. A chunk
+ * is extended to the end of the line it stops in.
+ */
+#define SCRIPT_CHUNK (256 * 1024)
+
+/**
+ * Scripts at least this large are parsed on the pool of
+ * threads, if there is one (see the -T option).
+ */
+#define SCRIPT_PARALLEL_MIN (4 * 1024 * 1024)
+
+/**
+ * The most threads -T takes. Each of them parses ahead
+ * into chunks of its own, so there is no point to more.
+ */
+#define MAX_THREADS 1024
+
+
+static void report_error(const struct parse_error *err)
+{
+    fprintf(stderr, "Line %zu, Position %zu, Parse error: %s\n", 
+            err->lineno, err->charno, err->message);
+}
+
+static void report_errors(const struct parse_error *err)
+{
+    for (; err != NULL; err = err->next)
+        report_error(err);
+}
+
+/**
+ * Parses the text from {@begin} to {@end}, which may span many lines.
+ * Returns the pipelines to execute, or NULL if there were parse errors.
+ */
+static struct llist *parse_text(struct pcfsh_context *ctx,
+        const char *begin, const char *end, struct parse_error **err_listp)
+{
+#ifdef PARSETREE_DEBUG
+    /* go through a parse tree, so that we can look at it */
+    struct llist *token_list = pcfsh_tokenize(ctx, &begin, end);
+    struct parse *tree = pcfsh_parse(ctx, token_list, err_listp);
+    struct llist *pipelines;
+
+    prstree_debug(tree);
+    if (*err_listp != NULL)
+        return NULL;
+    if ((pipelines = pcfsh_analyze(ctx, tree)) == NULL)
+        perror("pcfsh_analyze");
+    return pipelines;
+#else
+    /* parse and analyze it in one pass */
+    return pcfsh_parse_text(ctx, begin, end, err_listp);
+#endif
+}
+
+/**
+ * Executes the pipelines in order, checking on the jobs
+ * between lines as if they had been read one at a time.
+ * If the lines up to {@end} came from {@input}, each job that may
+ * read it gets it positioned right after the job's line. Returns
+ * false if a job did read from it, since the lines after that
+ * job's are then no longer what comes next in the input.
+ * If {@last}, nothing comes after {@end}, so the last pipeline
+ * is the last thing the shell does (see job_exec_last()).
+ */
+static bool exec_pipelines(struct pcfsh_context *ctx, struct llist *pipelines,
+        struct reader *input, const char *end, bool last)
 {
-    char *line = NULL;
+    size_t lineno = 0;
+
+    jobs_prefetch(pipelines);
+
+    for (struct link *lnk = pipelines->head; lnk != NULL; lnk = lnk->next) {
+        struct an_pipeline *pln = lnk->data;
+        const char *src_end = pln->source.data + pln->source.len;
+        const char *nl;
+
+        if (lnk != pipelines->head && pln->lineno != lineno)
+            jobs_notifications();
+        lineno = pln->lineno;
+
+        if (last && lnk->next == NULL) {
+            job_exec_last(pln);
+            continue;
+        }
+
+        if (input == NULL || !job_reads_input(pln)) {
+            job_exec(pln);
+            continue;
+        }
+
+        nl = memchr(src_end, '\n', end - src_end);
+        reader_sync(input, nl != NULL ? nl + 1 : end);
+        job_exec(pln);
+        if (reader_after_job(input)) {
+            /* the lines we have not run were never read, as far as the script is concerned */
+            ctx->num_lines = pln->lineno;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Executes pipelines that were parsed ahead of time, reporting the
+ * errors of the lines that could not be parsed among them, in order.
+ * If {@last}, they are the end of the script.
+ */
+static void exec_parsed(struct llist *pipelines, const struct parse_error *err, bool last)
+{
+    size_t lineno = 0;
+
+    jobs_prefetch(pipelines);
+
+    for (struct link *lnk = pipelines->head; lnk != NULL; lnk = lnk->next) {
+        struct an_pipeline *pln = lnk->data;
+
+        if (pln->lineno != lineno) {
+            if (lnk != pipelines->head)
+                jobs_notifications();
+            for (; err != NULL && err->lineno < pln->lineno; err = err->next)
+                report_error(err);
+        }
+        lineno = pln->lineno;
+
+        if (last && lnk->next == NULL && err == NULL)
+            job_exec_last(pln);
+        else
+            job_exec(pln);
+    }
+
+    report_errors(err);
+}
+
+/**
+ * Parses and executes a single line.
+ */
+static bool run_line(struct pcfsh_context *ctx, const char *begin, const char *end,
+        struct reader *input, bool last)
+{
+    struct parse_error *err_list = NULL;
+    struct llist *pipelines = parse_text(ctx, begin, end, &err_list);
+    bool cont = true;
+
+    if (err_list != NULL)
+        report_errors(err_list);
+    else if (pipelines != NULL)
+        cont = exec_pipelines(ctx, pipelines, input, end, last);
+
+    /* cleanup: job_exec() copied out whatever it keeps */
+    pcfsh_context_reset(ctx);
+    return cont;
+}
+
+/**
+ * Runs the lines from {@begin} to {@end} with one pass of the
+ * tokenizer and parser. If any line has an error, falls back to
+ * running them one by one, so that only the bad lines are skipped.
+ * The lines may come from {@input}, and may be the {@last} ones,
+ * see exec_pipelines().
+ */
+static void run_lines(struct pcfsh_context *ctx, const char *begin, const char *end,
+        struct reader *input, bool last)
+{
+    struct parse_error *err_list = NULL;
+    size_t lines_before = ctx->num_lines;
+    struct llist *pipelines = parse_text(ctx, begin, end, &err_list);
+
+    if (pipelines != NULL) {
+        exec_pipelines(ctx, pipelines, input, end, last);
+        pcfsh_context_reset(ctx);
+        jobs_notifications();
+        return;
+    }
+
+    pcfsh_context_reset(ctx);
+    ctx->num_lines = lines_before;
+
+    while (begin < end) {
+        const char *nl = memchr(begin, '\n', end - begin);
+        const char *line_end = nl != NULL ? nl + 1 : end;
+        bool cont = run_line(ctx, begin, line_end, input, last && line_end == end);
+
+        jobs_notifications();
+        if (!cont)
+            break;
+        begin = line_end;
+    }
+}
+
+/**
+ * Runs the commands read from {@fd}, in blocks of whole lines.
+ */
+static void run_input(struct pcfsh_context *ctx, int fd)
+{
+    struct reader input;
+    const char *begin;
+    const char *end;
+
+    reader_init(&input, fd);
+    while (reader_next(&input, &begin, &end))
+        run_lines(ctx, begin, end, &input, false);
+    reader_destroy(&input);
+}
+
+/**
+ * Runs the commands typed at the terminal. While it waits for a line,
+ * the shell also waits for SIGCHLD, through a signalfd, so that children
+ * are reaped as soon as they change state, and their jobs are reported
+ * right away, on a line of their own followed by a new prompt. Whatever
+ * was typed so far stays in the terminal's line buffer.
+ */
+static void run_interactive(struct pcfsh_context *ctx)
+{
+    struct epoll_event ev = { .events = EPOLLIN };
+    char *buf = NULL;
+    size_t capacity = 0;
     size_t len = 0;
+    sigset_t chld;
+    int sfd;
+    int epfd;
+
+    /* only blocked while waiting, so that the commands do not inherit it */
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+
+    sfd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    ev.data.fd = STDIN_FILENO;
+    if (sfd == -1 || epfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == -1) {
+        /* then the jobs are only looked at after each line */
+        perror("pcfsh: waiting for children");
+        if (epfd != -1)
+            close(epfd);
+        epfd = -1;
+    } else {
+        ev.data.fd = sfd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev);
+    }
 
-    pcfsh_init();
     pcfsh_prefix(NULL);
 
-    while (getline(&line, &len, stdin) != -1) {
-        struct llist *token_list = NULL;
-        struct parse *tree = NULL;
-        struct parse_error *err_list = NULL;
-        const char *after = line;
-        struct llist *pipelines = NULL;
+    for (;;) {
+        struct epoll_event events[2];
+        bool input = epfd == -1;
+        bool children = false;
+        const char *begin;
+        const char *nl;
+        ssize_t nread;
 
-        /* parse the current line */
-        token_list = tokenize(&after);
-        tree = rdparser(token_list, &err_list);
+        if (!input) {
+            int n = epoll_wait(epfd, events, 2, -1);
 
-#ifdef PARSETREE_DEBUG
-        prstree_debug(tree);
-#endif
+            if (n == -1 && errno != EINTR) {
+                perror("epoll_wait");
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.fd == sfd)
+                    children = true;
+                else
+                    input = true;
+            }
+        }
 
-        if (err_list != NULL) {
-            struct parse_error *err = err_list;
+        if (children) {
+            struct signalfd_siginfo si;
 
-            while (err != NULL) {
-                fprintf(stderr, "Line %zu, Position %zu, Parse error: %s\n", 
-                        err->lineno, err->charno, err->message);
-                err = err->next;
+            /* one wait covers them all */
+            while (read(sfd, &si, sizeof(si)) == sizeof(si))
+                ;
+            if (jobs_reap()) {
+                write(STDOUT_FILENO, "\n", 1);
+                jobs_notifications();
+                pcfsh_prefix(NULL);
             }
-        } else {
-            /* if parsing went well, analyze it */
-            pipelines = analyze_pipelines(tree);
+        }
 
-            /* execute all pipelines */
-            for (struct link *lnk = pipelines->head; lnk != NULL; lnk = lnk->next)
-                job_exec(lnk->data);
+        if (!input)
+            continue;
+
+        if (len == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 1024;
+            buf = realloc(buf, capacity);
         }
 
-        /* cleanup */
-        list_destroy(token_list, (void (*)(void *))token_destroy);
-        tree_destroy(tree);
-        errlist_destroy(err_list);
-        list_destroy(pipelines, (void (*)(void *))an_pipeline_destroy);
+        nread = read(STDIN_FILENO, buf + len, capacity - len);
+        if (nread < 0 && errno == EINTR)
+            continue;
+        if (nread <= 0) {
+            /* the last line may lack a newline */
+            if (len > 0) {
+                sigprocmask(SIG_UNBLOCK, &chld, NULL);
+                run_line(ctx, buf, buf + len, NULL, false);
+            }
+            break;
+        }
+        len += nread;
 
-        /* update statuses and get notifications */
-        jobs_notifications();
-        /* shell prefix */
-        pcfsh_prefix(NULL);
+        /* the terminal hands over a line at a time, but a paste is many */
+        begin = buf;
+        while ((nl = memchr(begin, '\n', buf + len - begin)) != NULL) {
+            sigprocmask(SIG_UNBLOCK, &chld, NULL);
+            run_line(ctx, begin, nl + 1, NULL, false);
+            /* blocked first, so that no SIGCHLD after the last wait is lost */
+            sigprocmask(SIG_BLOCK, &chld, NULL);
+
+            /* update statuses and get notifications */
+            jobs_notifications();
+            /* shell prefix */
+            pcfsh_prefix(NULL);
+            begin = nl + 1;
+        }
+
+        len -= begin - buf;
+        memmove(buf, begin, len);
+    }
+
+    sigprocmask(SIG_UNBLOCK, &chld, NULL);
+    if (epfd != -1)
+        close(epfd);
+    if (sfd != -1)
+        close(sfd);
+    free(buf);
+}
+
+/**
+ * Maps the script at {@path} and runs it in chunks of whole lines.
+ * A large script is parsed ahead on {@num_threads} threads, if there
+ * is more than one. Returns nonzero if the script could not be read.
+ */
+static int run_script(struct pcfsh_context *ctx, const char *path, size_t num_threads)
+{
+    struct stat st;
+    const char *script;
+    const char *p;
+    const char *end;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &st) == -1) {
+        perror(path);
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    script = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (script == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    madvise((void *) script, st.st_size, MADV_SEQUENTIAL);
+
+    p = script;
+    end = script + st.st_size;
+
+    if (num_threads > 1 && st.st_size >= SCRIPT_PARALLEL_MIN) {
+        struct pparser *pp = pparser_new(p, end, num_threads, &ctx->arena.allocator);
+        struct llist *pipelines;
+        struct parse_error *errors;
+
+        /* only the parsing runs ahead, the pipelines still run one by one */
+        while (pparser_next(pp, &pipelines, &errors, &ctx->num_lines)) {
+            exec_parsed(pipelines, errors, pparser_done(pp));
+            jobs_notifications();
+        }
+
+        pparser_destroy(pp);
+        p = end;
+    }
+
+    while (p < end) {
+        const char *chunk_end = end;
+
+        if (end - p > SCRIPT_CHUNK) {
+            const char *nl = memchr(p + SCRIPT_CHUNK, '\n', end - (p + SCRIPT_CHUNK));
+
+            chunk_end = nl != NULL ? nl + 1 : end;
+        }
+
+        run_lines(ctx, p, chunk_end, NULL, chunk_end == end);
+        p = chunk_end;
+    }
+
+    munmap((void *) script, st.st_size);
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-Z] [-T threads] [script [args...]]\n"
+            "       %s [-Z] -c cmdline [name [args...]]\n"
+            "       %s -n|--check [--json] [-T threads] [file...]\n",
+            name, name, name);
+}
+
+int main(int argc, char *argv[])
+{
+    /* everything the parse of a line allocates comes from here */
+    struct pcfsh_context ctx;
+    size_t num_threads = 0;
+    bool check = false;
+    bool json = false;
+    bool command = false;
+    int opt;
+    static const struct option long_options[] = {
+        { "check", no_argument, NULL, 'n' },
+        { "json", no_argument, NULL, 'j' },
+        { 0 }
+    };
+
+    /**
+     * pcfsh [-Z] [-T threads] [script [args...]]
+     * pcfsh [-Z] -c cmdline [name [args...]]
+     * pcfsh -n|--check [--json] [-T threads] [file...]
+     * -T: parse on this many threads, 0 for one per CPU.
+     * -Z: start programs from a helper process forked at startup.
+     * -c: run the commands in cmdline instead of a script.
+     * -n: only check the syntax of the files, running nothing.
+     */
+    while ((opt = getopt_long(argc, argv, "+cnT:Z", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'c':
+                command = true;
+                break;
+            case 'n':
+                check = true;
+                break;
+            case 'j':
+                json = true;
+                break;
+            case 'T': {
+                char *end;
+
+                errno = 0;
+                num_threads = strtoul(optarg, &end, 10);
+                if (*optarg < '0' || *optarg > '9' || *end != '\0'
+                        || errno == ERANGE || num_threads > MAX_THREADS) {
+                    fprintf(stderr, "%s: -T %s: expected a number of threads up to %d\n",
+                            argv[0], optarg, MAX_THREADS);
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                if (num_threads == 0)
+                    num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+                break;
+            }
+            case 'Z':
+                pcfsh_use_zygote(true);
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    /**
+     * The shortest way from here to exec(): nothing that a simple
+     * command does not need is set up, in particular neither the
+     * terminal nor stdio, and the last command is exec()d in place.
+     * Like the script's, the arguments after cmdline are accepted,
+     * but there is no way to refer to them yet.
+     */
+    if (command) {
+        const char *cmdline = argv[optind];
+
+        if (cmdline == NULL) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        pcfsh_context_init(&ctx, NULL);
+        pcfsh_init(false);
+        run_lines(&ctx, cmdline, cmdline + strlen(cmdline), NULL, true);
+        pcfsh_context_destroy(&ctx);
+        return pcfsh_status();
+    }
+
+    /* the files are checked one per thread, as many at once as there are CPUs */
+    if (check) {
+        if (num_threads == 0)
+            num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        return check_files(argv + optind, argc - optind, num_threads, json) == 0
+            ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    pcfsh_context_init(&ctx, NULL);
+
+    /**
+     * The arguments after the script are accepted,
+     * but there is no way to refer to them yet.
+     */
+    if (optind < argc) {
+        int status;
+
+        pcfsh_init(false);
+        status = run_script(&ctx, argv[optind], num_threads);
+        pcfsh_context_destroy(&ctx);
+        return status == 0 ? pcfsh_status() : EXIT_FAILURE;
+    }
+
+    pcfsh_init(true);
+
+    /* commands piped or redirected in are read in blocks */
+    if (!pcfsh_interactive()) {
+        run_input(&ctx, STDIN_FILENO);
+        pcfsh_context_destroy(&ctx);
+        return pcfsh_status();
     }
 
-    free(line);
+    run_interactive(&ctx);
+    pcfsh_context_destroy(&ctx);
 
     /**
      * jobs_cleanup() should be called here.
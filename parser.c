@@ -1,154 +1,167 @@
 #include "parser.h"
+#include "scan.h"
 #include "ds/llist.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <string.h>
-#include <stdarg.h>
+#include <stdbool.h>
 #include <unistd.h> /* fork(), exec() */
 
 /* TODO: implement environment variable substitution ? */
 
-size_t num_lines = 0;
 
-void token_destroy(struct token *tk)
+/**
+ * Copies the {@len} bytes at {@str} into the arena, dropping the
+ * backslash of each escape sequence. Inside a string only "\\"
+ * and a backslash followed by {@delim} are escapes; if {@delim} is
+ * '\0', a backslash escapes whatever follows it. The span's data is
+ * NULL if the arena is out of memory.
+ */
+static struct span unescape(struct arena *arena, const char *str, size_t len, char delim)
 {
-    free(tk->str_data);
-    free(tk);
+    char *buf = arena_alloc(arena, len);
+    size_t n = 0;
+
+    if (buf == NULL)
+        return (struct span) { NULL, 0 };
+
+    for (size_t i = 0; i < len; ++i) {
+        if (str[i] == '\\' && i + 1 < len
+                && (delim == '\0' || str[i + 1] == '\\' || str[i + 1] == delim))
+            ++i;
+        buf[n++] = str[i];
+    }
+
+    return (struct span) { buf, n };
 }
 
 /**
  * Parse a quoted string, with {@delim} as the delimeter.
+ * The token refers to the input, unless escape sequences
+ * have to be removed. Returns NULL if the arena is out of memory.
  */
-static struct token *parse_string(const char **input, char delim)
+static struct token *parse_string(struct arena *arena,
+        const char **input, const char *end, char delim)
 {
-    struct token *tk = calloc(1, sizeof(struct token));
-    size_t string_length = 0;
-    size_t buf_size = 1;
+    struct token *tk = arena_calloc(arena, 1, sizeof(struct token));
+    const char *start;
+    const char *p;
+    bool escaped = false;
+
+    if (tk == NULL)
+        return NULL;
 
     tk->cat = delim == '"' ? CAT_STRING_DBL : CAT_STRING_SNGL;
-    tk->str_data = malloc(buf_size);
 
     /* advance past the first quotation mark */
-    (*input)++;
-
-    while (**input != delim && **input != '\0') {
-        char c = **input;
-        char next_c = (*input)[1];
-
-        if (c == '\\' && (next_c == '\\' || next_c == delim)) {
-            tk->str_data[string_length] = next_c;
-
-            if (++string_length >= buf_size) {
-                buf_size *= 2;
-                tk->str_data = realloc(tk->str_data, buf_size);
-            }
-
-            (*input) += 2;
-        } else {
-            tk->str_data[string_length] = c;
-
-            if (++string_length >= buf_size) {
-                buf_size *= 2;
-                tk->str_data = realloc(tk->str_data, buf_size);
-            }
-
-            (*input)++;
-        }
+    start = p = *input + 1;
+
+    /* skip to the next backslash, delimiter, newline, or NUL */
+    while ((p += scan_string(p, end, delim)) < end && *p == '\\') {
+        if (p + 1 < end && (p[1] == '\\' || p[1] == delim)) {
+            escaped = true;
+            p += 2;
+        } else
+            p++;
     }
 
-    /* put trailing NUL byte */
-    tk->str_data = realloc(tk->str_data, string_length + 1);
-    tk->str_data[string_length] = '\0';
+    *input = p;
 
-    if (**input == '\0') {
+    if (p == end || *p != delim) {
         /* we did not find a matching quotation mark */
-        char msg[48];
-
         tk->cat = CAT_ERROR;
-        free(tk->str_data);
-        snprintf(msg, 48, "Expected '%c'", delim);
-        tk->str_data = strdup(msg);
+        tk->text = delim == '"' ? SPAN_LITERAL("Expected '\"'")
+                                : SPAN_LITERAL("Expected '\''");
         return tk;
     }
 
+    if (escaped) {
+        tk->text = unescape(arena, start, p - start, delim);
+        if (tk->text.data == NULL)
+            return NULL;
+    } else
+        tk->text = (struct span) { start, p - start };
+
     /* advance past the last quotation mark */
     (*input)++;
 
     return tk;
 }
 
-#define isop(c) (c == '|' || c == '&' || c == '<' || c == '>' || c == ';')
-
 /**
  * Parses an argument, which may also be a relative or absolute path.
+ * The token refers to the input, unless escape sequences
+ * have to be removed. Returns NULL if the arena is out of memory.
  */
-static struct token *parse_arg(const char **input)
+static struct token *parse_arg(struct arena *arena, const char **input, const char *end)
 {
-    struct token *tk = calloc(1, sizeof(struct token));
-    size_t buf_size = 1;
-    size_t string_length = 0;
-
-    tk->cat = CAT_ARG;
-    tk->str_data = malloc(buf_size);
+    struct token *tk = arena_calloc(arena, 1, sizeof(struct token));
+    const char *start = *input;
+    const char *p = start;
+    bool escaped = false;
+    bool has_slash = false;
 
-    while (!isspace(**input) && !isop(**input) && **input != '\0') {
-        char c = **input;
-        char next_c = (*input)[1];
-
-        if (c == '\\' && next_c != '\0') {
-            tk->str_data[string_length] = next_c;
-
-            if (next_c == '/')
-                tk->cat = CAT_PATH_REL;
-
-            if (++string_length >= buf_size) {
-                buf_size *= 2;
-                tk->str_data = realloc(tk->str_data, buf_size);
-            }
-
-            (*input) += 2;
-        } else {
-            tk->str_data[string_length] = c;
-
-            if (c == '/')
-                tk->cat = CAT_PATH_REL;
-
-            if (++string_length >= buf_size) {
-                buf_size *= 2;
-                tk->str_data = realloc(tk->str_data, buf_size);
-            }
+    if (tk == NULL)
+        return NULL;
 
-            (*input)++;
-        }
+    /* skip to the next backslash or the end of the argument.
+     * A backslash cannot escape the end of the line. */
+    while ((p += scan_arg(p, end, &has_slash)) < end && *p == '\\') {
+        if (p + 1 < end && p[1] != '\0' && p[1] != '\n') {
+            escaped = true;
+            if (p[1] == '/')
+                has_slash = true;
+            p += 2;
+        } else
+            p++;
     }
 
-    tk->str_data = realloc(tk->str_data, string_length + 1);
-    tk->str_data[string_length] = '\0';
+    *input = p;
+
+    if (escaped) {
+        tk->text = unescape(arena, start, p - start, '\0');
+        if (tk->text.data == NULL)
+            return NULL;
+    } else
+        tk->text = (struct span) { start, p - start };
 
-    if (tk->str_data[0] == '/')
+    if (tk->text.data[0] == '/')
         tk->cat = CAT_PATH_ABS;
+    else if (has_slash)
+        tk->cat = CAT_PATH_REL;
+    else
+        tk->cat = CAT_ARG;
 
     return tk;
 }
 
-struct llist *tokenize(const char **input)
+struct llist *tokenize(struct arena *arena, const char **input, const char *end,
+        size_t *num_lines)
 {
-    struct llist *tokens = list_new();
-    size_t cur_line = 0;
-    const char *in_base = *input;
+    struct llist *tokens = list_new_arena(arena);
+    const char *line_base = *input;
+
+    if (tokens == NULL)
+        return NULL;
 
-    while (**input) {
+    while (*input < end) {
         char c = **input;
 
-        if (c == '|' || c == '&' || c == '<' || c == '>' || c  == ';' || c == '\n') {
-            struct token *tk = calloc(1, sizeof(struct token));
+        if (c == '\0') {
+            /* ignore the rest of the line */
+            const char *nl = memchr(*input, '\n', end - *input);
+
+            *input = nl != NULL ? nl : end;
+        } else if (scan_is(c, SCAN_OP | SCAN_NEWLINE)) {
+            struct token *tk = arena_calloc(arena, 1, sizeof(struct token));
 
-            tk->str_data = malloc(2);
-            tk->str_data[0] = c;
-            tk->str_data[1] = '\0';
-            tk->lineno = cur_line;
-            tk->charno = *input - in_base;
+            if (tk == NULL)
+                return NULL;
+
+            tk->text = (struct span) { *input, 1 };
+            tk->raw = tk->text;
+            tk->lineno = *num_lines + 1;
+            tk->charno = *input - line_base;
 
             switch (c) {
                 case '|':
@@ -168,8 +181,8 @@ struct llist *tokenize(const char **input)
                     break;
                 case '\n':
                     tk->cat = CAT_NEWLINE;
-                    num_lines++;
-                    cur_line++;
+                    (*num_lines)++;
+                    line_base = *input + 1;
                     break;
                 default:
                     /* we shouldn't get here */
@@ -177,24 +190,29 @@ struct llist *tokenize(const char **input)
                     break;
             }
 
-            list_append(tokens, tk);
+            if (list_append(tokens, tk) == -1)
+                return NULL;
 
             (*input)++;
-        } else if (isspace(c)) {
+        } else if (scan_is(c, SCAN_SPACE)) {
             (*input)++;
         } else {
             struct token *tk;
-            size_t charno = *input - in_base;
+            const char *start = *input;
 
             /* these parse routines advance the position in the input string */
-            if (c == '"' || c == '\'')
-                tk = parse_string(input, c);
+            if (scan_is(c, SCAN_QUOTE))
+                tk = parse_string(arena, input, end, c);
             else
-                tk = parse_arg(input);
-
-            tk->charno = charno;
-            tk->lineno = cur_line;
-            list_append(tokens, tk);
+                tk = parse_arg(arena, input, end);
+            if (tk == NULL)
+                return NULL;
+
+            tk->raw = (struct span) { start, *input - start };
+            tk->charno = start - line_base;
+            tk->lineno = *num_lines + 1;
+            if (list_append(tokens, tk) == -1)
+                return NULL;
         }
     }
 
@@ -202,73 +220,38 @@ struct llist *tokenize(const char **input)
 }
 
 /**
- * Make a tree with zero children.
+ * Make a tree with zero children. Returns NULL if the arena is out of memory.
  */
-static struct parse *make_tree0(enum prod type, struct token *token)
+static struct parse *make_tree0(struct arena *arena, enum prod type, struct token *token)
 {
-    struct parse *tree = calloc(1, sizeof(struct parse));
+    struct parse *tree = arena_calloc(arena, 1, sizeof(struct parse));
+
+    if (tree == NULL)
+        return NULL;
     tree->type = type;
     tree->token = token;
 
     return tree;
 }
 
-/**
- * Make a tree with one child.
- */
-static struct parse *make_tree1(enum prod type, struct token *token, struct parse *child)
-{
-    struct parse *tree = make_tree0(type, token);
-    tree->lchild = child;
-    return tree;
-}
-
-/**
- * Make a tree with N children. This list must be NULL-terminated.
- */
-static struct parse *make_treeN(enum prod type, struct token *token, struct parse *lchild, ...)
-{
-    struct parse *tree = make_tree1(type, token, lchild);
-    va_list args;
-    struct parse *arg;
-
-    va_start(args, lchild);
-
-    while ((arg = va_arg(args, struct parse *)) != NULL) {
-        lchild->rsibling = arg;
-        lchild = arg;
-    }
-
-    va_end(args);
-
-    return tree;
-}
-
-void tree_destroy(struct parse *tree)
-{
-    if (tree == NULL)
-        return;
-
-    tree_destroy(tree->rsibling);
-    tree_destroy(tree->lchild);
-
-    free(tree);
-}
-
 /**
  * Prepend a new error message onto the error list.
+ * Returns -1 if the arena is out of memory.
  */
-static void errlist_ppnd(struct parse_error **err_listp,
-        size_t lineno, size_t charno, const char *message)
+static int errlist_ppnd(struct arena *arena, struct parse_error **err_listp,
+        size_t lineno, size_t charno, struct span message)
 {
-    struct parse_error *perr = calloc(1, sizeof(struct parse_error));
+    struct parse_error *perr = arena_calloc(arena, 1, sizeof(struct parse_error));
+
+    if (perr == NULL || (perr->message = arena_strndup(arena, message.data, message.len)) == NULL)
+        return -1;
 
     perr->charno = charno;
-    perr->lineno = num_lines + lineno;
-    perr->message = strdup(message);
+    perr->lineno = lineno;
     perr->next = *err_listp;
 
     *err_listp = perr;
+    return 0;
 }
 
 static inline int match_NAME(const struct token *token) {
@@ -279,363 +262,318 @@ static inline int match_NAME(const struct token *token) {
         || token->cat == CAT_PATH_REL;
 }
 
-static struct parse *rdparse_NAME(const struct link **list,
-        struct parse_error **err_listp)
-{
-    struct parse *child = NULL;
-    struct token *cur_tk;
-
-    if (*list == NULL || !match_NAME(cur_tk = (*list)->data)) {
-        if (*list != NULL)
-            errlist_ppnd(err_listp, cur_tk->lineno, cur_tk->charno,
-                    "Expected an argument, a string, or a path.");
-        return NULL;
-    }
-
-    child = make_tree0(PROD_TERMINAL, cur_tk);
-    *list = (*list)->next;
+/**
+ * The parser is a table-driven LL(1) parser. It keeps the symbols
+ * it still expects on an explicit stack instead of recursing, so
+ * neither long argument lists nor long programs use up the C stack.
+ */
 
-    return make_tree1(PROD_NAME, NULL, child);
-}
+/**
+ * What the next token looks like to the parser.
+ */
+enum lookahead {
+    LA_NAME,
+    LA_PIPE,
+    LA_AMPERSAND,
+    LA_LANGLE,
+    LA_RANGLE,
+    LA_SEMICOLON,
+    LA_NEWLINE,
+    LA_ERROR,
+    /* there are no tokens left */
+    LA_END,
+    NUM_LOOKAHEADS
+};
 
-static struct parse *rdparse_ARGLIST(const struct link **list,
-        struct parse_error **err_listp)
-{
-    struct parse *ch_name = NULL;
-    struct parse *ch_arglist = NULL;
-    struct token *cur_tk = NULL;
-
-    if (*list == NULL || !match_NAME(cur_tk = (*list)->data)) {
-        if (*list != NULL && cur_tk->cat == CAT_ERROR) {
-            errlist_ppnd(err_listp, cur_tk->lineno, 
-                    cur_tk->charno, cur_tk->str_data);
-            /* error */
-            return NULL;
-        }
+/**
+ * A grammar symbol. Terminals are numbered by their lookahead,
+ * productions come after them.
+ */
+#define SYM_TERM(la) (la)
+#define SYM_PROD(prod) (NUM_LOOKAHEADS + (prod))
+#define SYM_IS_TERM(sym) ((sym) < NUM_LOOKAHEADS)
 
-        /* epsilon */
-        return make_tree0(PROD_ARGLIST, NULL);
-    }
+/**
+ * The right-hand sides of the grammar in parser.h.
+ */
+enum rule {
+    /* the production derives the empty string */
+    RULE_EPSILON,
+    /* the token is not allowed here */
+    RULE_SYNTAX_ERROR,
+    RULE_NAME,
+    RULE_ARGLIST,
+    RULE_AMP_OP,
+    RULE_STDIN_PIPE,
+    RULE_STDOUT_PIPE,
+    RULE_PIPELINE,
+    RULE_PIPELINE_TAIL,
+    RULE_PLN_LIST,
+    RULE_LINE,
+    RULE_LINES_LIST,
+    RULE_PROGRAM,
+    NUM_RULES
+};
 
-    if ((ch_name = rdparse_NAME(list, err_listp)) == NULL
-     || (ch_arglist = rdparse_ARGLIST(list, err_listp)) == NULL) {
-        tree_destroy(ch_name);
-        tree_destroy(ch_arglist);
-        /* TODO: error */
-        return NULL;
-    }
+#define RULE_MAX_LEN 6
+
+static const struct rule_rhs {
+    size_t len;
+    int syms[RULE_MAX_LEN];
+} rule_rhs[NUM_RULES] = {
+    [RULE_NAME] = { 1, { SYM_TERM(LA_NAME) } },
+    [RULE_ARGLIST] = { 2, { SYM_PROD(PROD_NAME), SYM_PROD(PROD_ARGLIST) } },
+    [RULE_AMP_OP] = { 1, { SYM_TERM(LA_AMPERSAND) } },
+    [RULE_STDIN_PIPE] = { 2, { SYM_TERM(LA_LANGLE), SYM_PROD(PROD_NAME) } },
+    [RULE_STDOUT_PIPE] = { 2, { SYM_TERM(LA_RANGLE), SYM_PROD(PROD_NAME) } },
+    [RULE_PIPELINE] = { 6, {
+        SYM_PROD(PROD_NAME), SYM_PROD(PROD_ARGLIST), SYM_PROD(PROD_STDIN_PIPE),
+        SYM_PROD(PROD_PIPELINE_TAIL), SYM_PROD(PROD_STDOUT_PIPE), SYM_PROD(PROD_AMP_OP)
+    } },
+    [RULE_PIPELINE_TAIL] = { 4, {
+        SYM_TERM(LA_PIPE), SYM_PROD(PROD_NAME), SYM_PROD(PROD_ARGLIST),
+        SYM_PROD(PROD_PIPELINE_TAIL)
+    } },
+    [RULE_PLN_LIST] = { 2, { SYM_TERM(LA_SEMICOLON), SYM_PROD(PROD_LINE) } },
+    [RULE_LINE] = { 2, { SYM_PROD(PROD_PIPELINE), SYM_PROD(PROD_PLN_LIST) } },
+    [RULE_LINES_LIST] = { 2, { SYM_TERM(LA_NEWLINE), SYM_PROD(PROD_PROGRAM) } },
+    [RULE_PROGRAM] = { 2, { SYM_PROD(PROD_LINE), SYM_PROD(PROD_LINES_LIST) } }
+};
 
-    return make_treeN(PROD_ARGLIST, NULL, ch_name, ch_arglist, NULL);
-}
+/**
+ * The parse table: which rule to expand a production with, given the lookahead.
+ * Missing entries are RULE_EPSILON. Since <line> derives the empty
+ * string, a <program> may also start with a newline (a blank line).
+ */
+static const unsigned char ll1_table[PROD_TERMINAL][NUM_LOOKAHEADS] = {
+    [PROD_NAME] = {
+        [0 ... NUM_LOOKAHEADS - 1] = RULE_SYNTAX_ERROR,
+        [LA_NAME] = RULE_NAME
+    },
+    [PROD_ARGLIST] = { [LA_NAME] = RULE_ARGLIST },
+    [PROD_AMP_OP] = { [LA_AMPERSAND] = RULE_AMP_OP },
+    [PROD_STDIN_PIPE] = { [LA_LANGLE] = RULE_STDIN_PIPE },
+    [PROD_STDOUT_PIPE] = { [LA_RANGLE] = RULE_STDOUT_PIPE },
+    [PROD_PIPELINE] = {
+        [0 ... NUM_LOOKAHEADS - 1] = RULE_SYNTAX_ERROR,
+        [LA_NAME] = RULE_PIPELINE
+    },
+    [PROD_PIPELINE_TAIL] = { [LA_PIPE] = RULE_PIPELINE_TAIL },
+    [PROD_PLN_LIST] = { [LA_SEMICOLON] = RULE_PLN_LIST },
+    [PROD_LINE] = { [LA_NAME] = RULE_LINE },
+    [PROD_LINES_LIST] = { [LA_NEWLINE] = RULE_LINES_LIST },
+    [PROD_PROGRAM] = { [LA_NAME] = RULE_PROGRAM, [LA_NEWLINE] = RULE_PROGRAM }
+};
 
-static struct parse *rdparse_AMP_OP(const struct link **list,
-        struct parse_error **err_listp)
+static enum lookahead lookahead_of(const struct token *tk)
 {
-    struct parse *ch_ampersand = NULL;
-    struct token *cur_tk;
-
-    if (*list == NULL || (cur_tk = (*list)->data)->cat != CAT_AMPERSAND) {
-        if (*list != NULL && cur_tk->cat == CAT_ERROR) {
-            errlist_ppnd(err_listp, cur_tk->lineno, 
-                    cur_tk->charno, cur_tk->str_data);
-            /* error */
-            return NULL;
-        }
-
-        /* epsilon */
-        return make_tree0(PROD_AMP_OP, NULL);
+    if (tk == NULL)
+        return LA_END;
+
+    switch (tk->cat) {
+        case CAT_PIPE:
+            return LA_PIPE;
+        case CAT_AMPERSAND:
+            return LA_AMPERSAND;
+        case CAT_LANGLE:
+            return LA_LANGLE;
+        case CAT_RANGLE:
+            return LA_RANGLE;
+        case CAT_SEMICOLON:
+            return LA_SEMICOLON;
+        case CAT_NEWLINE:
+            return LA_NEWLINE;
+        case CAT_ERROR:
+            return LA_ERROR;
+        default:
+            return LA_NAME;
     }
-
-    ch_ampersand = make_tree0(PROD_TERMINAL, cur_tk);
-    (*list) = (*list)->next;
-
-    return make_tree1(PROD_AMP_OP, NULL, ch_ampersand);
 }
 
-static struct parse *rdparse_STDIN_PIPE(const struct link **list,
-        struct parse_error **err_listp)
-{
-    struct parse *ch_langle = NULL;
-    struct parse *ch_name = NULL;
-    struct token *cur_tk;
-
-    if (*list == NULL || (cur_tk = (*list)->data)->cat != CAT_LANGLE) {
-        if (*list != NULL && cur_tk->cat == CAT_ERROR) {
-            errlist_ppnd(err_listp, cur_tk->lineno, 
-                    cur_tk->charno, cur_tk->str_data);
-            /* error */
-            return NULL;
-        }
-
-        /* epsilon */
-        return make_tree0(PROD_STDIN_PIPE, NULL);
-    }
-
-    ch_langle = make_tree0(PROD_TERMINAL, cur_tk);
-    (*list) = (*list)->next;
-
-    if ((ch_name = rdparse_NAME(list, err_listp)) == NULL) {
-        tree_destroy(ch_langle);
-        tree_destroy(ch_name);
-        /* TODO: error */
-        return NULL;
-    }
+/**
+ * A symbol we still expect, and the tree node it will fill in.
+ */
+struct parse_item {
+    int sym;
+    struct parse *node;
+};
 
-    return make_treeN(PROD_STDIN_PIPE, NULL, ch_langle, ch_name, NULL);
-}
+struct parse_stack {
+    struct parse_item *items;
+    size_t size;
+    size_t capacity;
+    /**
+     * Where the items come from, or NULL for the heap.
+     */
+    struct arena *arena;
+};
 
-static struct parse *rdparse_STDOUT_PIPE(const struct link **list,
-        struct parse_error **err_listp)
+/**
+ * Returns -1 if there is no memory for another item.
+ */
+static int parse_stack_push(struct parse_stack *stack, int sym, struct parse *node)
 {
-    struct parse *ch_rangle = NULL;
-    struct parse *ch_name = NULL;
-    struct token *cur_tk;
-
-    if (*list == NULL || (cur_tk = (*list)->data)->cat != CAT_RANGLE) {
-        if (*list != NULL && cur_tk->cat == CAT_ERROR) {
-            errlist_ppnd(err_listp, cur_tk->lineno, 
-                    cur_tk->charno, cur_tk->str_data);
-            /* error */
-            return NULL;
-        }
-
-        /* epsilon */
-        return make_tree0(PROD_STDOUT_PIPE, NULL);
+    if (stack->size == stack->capacity) {
+        size_t capacity = stack->capacity != 0 ? stack->capacity * 2 : 16;
+        struct parse_item *items;
+
+        if (stack->arena != NULL)
+            items = arena_realloc(stack->arena, stack->items,
+                    stack->capacity * sizeof(*stack->items), capacity * sizeof(*stack->items));
+        else
+            items = realloc(stack->items, capacity * sizeof(*stack->items));
+        if (items == NULL)
+            return -1;
+        stack->items = items;
+        stack->capacity = capacity;
     }
 
-    ch_rangle = make_tree0(PROD_TERMINAL, cur_tk);
-    (*list) = (*list)->next;
-
-    if ((ch_name = rdparse_NAME(list, err_listp)) == NULL) {
-        tree_destroy(ch_rangle);
-        tree_destroy(ch_name);
-        /* TODO: error */
-        return NULL;
-    }
-
-    return make_treeN(PROD_STDOUT_PIPE, NULL, ch_rangle, ch_name, NULL);
+    stack->items[stack->size].sym = sym;
+    stack->items[stack->size].node = node;
+    stack->size++;
+    return 0;
 }
 
-static struct parse *rdparse_PIPELINE_TAIL(const struct link **list,
-        struct parse_error **err_listp)
+/**
+ * Reports a syntax error at {@tk}, or after {@prev} if we ran out of tokens.
+ * Returns -1 if the arena is out of memory.
+ */
+static int syntax_error(struct arena *arena, struct parse_error **err_listp,
+        const struct token *tk, const struct token *prev)
 {
-    struct parse *ch_pipe = NULL;
-    struct parse *ch_progname = NULL;
-    struct parse *ch_arglist = NULL;
-    struct parse *ch_pipeline_tail = NULL;
-    struct token *cur_tk;
-
-    if (*list == NULL || (cur_tk = (*list)->data)->cat != CAT_PIPE) {
-        if (*list != NULL && cur_tk->cat == CAT_ERROR) {
-            errlist_ppnd(err_listp, cur_tk->lineno, 
-                    cur_tk->charno, cur_tk->str_data);
-            /* error */
-            return NULL;
-        }
-
-        /* epsilon */
-        return make_tree0(PROD_PIPELINE_TAIL, NULL);
-    }
-
-    ch_pipe = make_tree0(PROD_TERMINAL, cur_tk);
-    (*list) = (*list)->next;
-
-    if ((ch_progname = rdparse_NAME(list, err_listp)) == NULL
-     || (ch_arglist = rdparse_ARGLIST(list, err_listp)) == NULL
-     || (ch_pipeline_tail = rdparse_PIPELINE_TAIL(list, err_listp)) == NULL) {
-        tree_destroy(ch_pipe);
-        tree_destroy(ch_progname);
-        tree_destroy(ch_arglist);
-        tree_destroy(ch_pipeline_tail);
-        return NULL;
-    }
-
-    return make_treeN(PROD_PIPELINE_TAIL, NULL,
-            ch_pipe, ch_progname, ch_arglist, ch_pipeline_tail, NULL);
+    struct span msg = SPAN_LITERAL("Expected an argument, a string, or a path.");
+
+    if (tk != NULL)
+        return errlist_ppnd(arena, err_listp, tk->lineno, tk->charno, msg);
+    else if (prev != NULL)
+        return errlist_ppnd(arena, err_listp, prev->lineno, prev->charno + prev->text.len, msg);
+    else
+        return errlist_ppnd(arena, err_listp, 0, 0, msg);
 }
 
-static struct parse *rdparse_PIPELINE(const struct link **list,
-        struct parse_error **err_listp)
+/**
+ * Runs the parser. If {@build_tree} is set, returns the parse tree,
+ * otherwise returns a non-NULL dummy on success. Either way, the
+ * events are reported to {@listener} if it is non-NULL. Running out
+ * of memory fails the parse, without an error for it.
+ */
+static struct parse *ll1_parse(struct arena *arena, const struct llist *tokens,
+        struct parse_error **err_listp, bool build_tree,
+        const struct parse_listener *listener, void *ctx)
 {
-    struct parse *ch_progname = NULL;
-    struct parse *ch_arglist = NULL;
-    struct parse *ch_stdin_pipe = NULL;
-    struct parse *ch_pipeline_tail = NULL;
-    struct parse *ch_stdout_pipe = NULL;
-    struct parse *ch_amp_op = NULL;
-
-    if ((ch_progname = rdparse_NAME(list, err_listp)) == NULL
-     || (ch_arglist = rdparse_ARGLIST(list, err_listp)) == NULL
-     || (ch_stdin_pipe = rdparse_STDIN_PIPE(list, err_listp)) == NULL
-     || (ch_pipeline_tail = rdparse_PIPELINE_TAIL(list, err_listp)) == NULL
-     || (ch_stdout_pipe = rdparse_STDOUT_PIPE(list, err_listp)) == NULL
-     || (ch_amp_op = rdparse_AMP_OP(list, err_listp)) == NULL) {
-        tree_destroy(ch_progname);
-        tree_destroy(ch_arglist);
-        tree_destroy(ch_stdin_pipe);
-        tree_destroy(ch_pipeline_tail);
-        tree_destroy(ch_stdout_pipe);
-        tree_destroy(ch_amp_op);
-
+    static struct parse no_tree;
+    struct parse_stack stack = { .arena = arena };
+    struct parse *tree = &no_tree;
+    const struct link *cur = tokens->head;
+    const struct token *prev = NULL;
+    bool failed = false;
+
+    if (build_tree && (tree = make_tree0(arena, PROD_PROGRAM, NULL)) == NULL)
+        return NULL;
+    if (parse_stack_push(&stack, SYM_PROD(PROD_PROGRAM), build_tree ? tree : NULL) == -1)
         return NULL;
-    }
-
-    return make_treeN(PROD_PIPELINE, NULL, 
-            ch_progname, ch_arglist, ch_stdin_pipe, ch_pipeline_tail, ch_stdout_pipe, ch_amp_op, NULL);
-}
-
-static struct parse *rdparse_LINE(const struct link **list,
-        struct parse_error **err_listp);
 
-static struct parse *rdparse_PLN_LIST(const struct link **list,
-        struct parse_error **err_listp)
-{
-    struct parse *ch_semicolon = NULL;
-    struct parse *ch_line = NULL;
+    while (stack.size != 0 && !failed) {
+        struct parse_item item = stack.items[--stack.size];
+        struct token *cur_tk = cur != NULL ? cur->data : NULL;
+        enum lookahead la = lookahead_of(cur_tk);
+
+        if (SYM_IS_TERM(item.sym)) {
+            /* predicted terminals always match the lookahead */
+            if ((int) la != item.sym) {
+                syntax_error(arena, err_listp, cur_tk, prev);
+                failed = true;
+                continue;
+            }
 
-    struct token *cur_tk;
+            if (item.node != NULL)
+                item.node->token = cur_tk;
+            if (listener != NULL)
+                listener->token(ctx, cur_tk);
+            prev = cur_tk;
+            cur = cur->next;
+        } else {
+            enum prod prod = item.sym - NUM_LOOKAHEADS;
+            enum rule rule = ll1_table[prod][la];
+            struct parse *children[RULE_MAX_LEN] = { NULL };
+            const struct rule_rhs *rhs;
+
+            switch (rule) {
+                case RULE_SYNTAX_ERROR:
+                    syntax_error(arena, err_listp, cur_tk, prev);
+                    failed = true;
+                    continue;
+                case RULE_EPSILON:
+                    if (la == LA_ERROR) {
+                        errlist_ppnd(arena, err_listp, cur_tk->lineno,
+                                cur_tk->charno, cur_tk->text);
+                        failed = true;
+                    }
+                    /* the node stays without children */
+                    continue;
+                default:
+                    break;
+            }
 
-    if (*list == NULL || (cur_tk = (*list)->data)->cat != CAT_SEMICOLON) {
-        if (*list != NULL && cur_tk->cat == CAT_ERROR) {
-            errlist_ppnd(err_listp, cur_tk->lineno, 
-                    cur_tk->charno, cur_tk->str_data);
-            /* error */
-            return NULL;
-        }
+            if (listener != NULL)
+                listener->expand(ctx, prod);
 
-        /* epsilon */
-        return make_tree0(PROD_PLN_LIST, NULL);
-    }
+            rhs = &rule_rhs[rule];
 
-    ch_semicolon = make_tree0(PROD_TERMINAL, cur_tk);
-    (*list) = (*list)->next;
+            /* link up the children */
+            if (item.node != NULL) {
+                struct parse **childp = &item.node->lchild;
 
-    if ((ch_line = rdparse_LINE(list, err_listp)) == NULL) {
-        tree_destroy(ch_semicolon);
-        tree_destroy(ch_line);
-        return NULL;
-    }
+                for (size_t i = 0; i < rhs->len; ++i) {
+                    int sym = rhs->syms[i];
 
-    return make_treeN(PROD_PLN_LIST, NULL, ch_semicolon, ch_line, NULL);
-}
+                    children[i] = make_tree0(arena,
+                            SYM_IS_TERM(sym) ? PROD_TERMINAL : sym - NUM_LOOKAHEADS, NULL);
+                    if (children[i] == NULL) {
+                        failed = true;
+                        break;
+                    }
+                    *childp = children[i];
+                    childp = &children[i]->rsibling;
+                }
+            }
 
-static struct parse *rdparse_LINE(const struct link **list,
-        struct parse_error **err_listp)
-{
-    struct parse *ch_pipeline = NULL;
-    struct parse *ch_pln_list = NULL;
-    struct token *cur_tk;
-
-    if (*list == NULL || !match_NAME(cur_tk = (*list)->data)) {
-        if (*list != NULL && cur_tk->cat == CAT_ERROR) {
-            errlist_ppnd(err_listp, cur_tk->lineno, 
-                    cur_tk->charno, cur_tk->str_data);
-            /* error */
-            return NULL;
+            /* expect them left to right */
+            for (size_t i = rhs->len; i-- > 0 && !failed; ) {
+                if (parse_stack_push(&stack, rhs->syms[i], children[i]) == -1)
+                    failed = true;
+            }
         }
-
-        /* epsilon */
-        return make_tree0(PROD_LINE, NULL);
     }
 
-    if ((ch_pipeline = rdparse_PIPELINE(list, err_listp)) == NULL
-     || (ch_pln_list = rdparse_PLN_LIST(list, err_listp)) == NULL) {
-        tree_destroy(ch_pipeline);
-        /* I know this last tree_destroy statement is 
-         * technically unnecessary, but I'm putting it here
-         * in case I change the above code later on. */
-        tree_destroy(ch_pln_list);
-        /* TODO: error */
-        return NULL;
-    }
+    /* a <program> has to use up all of the tokens */
+    if (!failed && cur != NULL) {
+        const struct token *tk = cur->data;
+        size_t len = sizeof("Unexpected ''.") + tk->text.len;
+        char *msg = arena_alloc(arena, len);
 
-    return make_treeN(PROD_LINE, NULL, ch_pipeline, ch_pln_list, NULL);
-}
-
-static struct parse *rdparse_PROGRAM(const struct link **list,
-        struct parse_error **err_listp);
-
-static struct parse *rdparse_LINES_LIST(const struct link **list,
-        struct parse_error **err_listp)
-{
-    struct parse *ch_newline = NULL;
-    struct parse *ch_program = NULL;
-    struct token *cur_tk;
-
-    if (*list == NULL || (cur_tk = (*list)->data)->cat != CAT_NEWLINE) {
-        if (*list != NULL && cur_tk->cat == CAT_ERROR) {
-            errlist_ppnd(err_listp, cur_tk->lineno, 
-                    cur_tk->charno, cur_tk->str_data);
-            /* error */
-            return NULL;
+        if (msg != NULL) {
+            snprintf(msg, len, "Unexpected '%.*s'.", (int) tk->text.len, tk->text.data);
+            errlist_ppnd(arena, err_listp, tk->lineno, tk->charno, (struct span) { msg, len - 1 });
         }
-
-        /* epsilon */
-        return make_tree0(PROD_LINES_LIST, NULL);
+        failed = true;
     }
 
-    ch_newline = make_tree0(PROD_TERMINAL, cur_tk);
-    *list = (*list)->next;
-
-    if ((ch_program = rdparse_PROGRAM(list, err_listp)) == NULL) {
-        tree_destroy(ch_newline);
-        tree_destroy(ch_program);
-        /* TODO: error */
-        return NULL;
-    }
-
-    return make_treeN(PROD_LINES_LIST, NULL, ch_newline, ch_program, NULL);
+    /* the stack and the partial tree are reclaimed with the arena */
+    return failed ? NULL : tree;
 }
 
-static struct parse *rdparse_PROGRAM(const struct link **list,
+struct parse *rdparser(struct arena *arena, const struct llist *tokens,
         struct parse_error **err_listp)
 {
-    struct parse *ch_line = NULL;
-    struct parse *ch_lines_list = NULL;
-    struct token *cur_tk;
-
-    if (*list == NULL || !match_NAME(cur_tk = (*list)->data)) {
-        if (*list != NULL && cur_tk->cat == CAT_ERROR) {
-            errlist_ppnd(err_listp, cur_tk->lineno, 
-                    cur_tk->charno, cur_tk->str_data);
-            /* error */
-            return NULL;
-        }
-        /* epsilon */
-        return make_tree0(PROD_PROGRAM, NULL);
-    }
-
-    if ((ch_line = rdparse_LINE(list, err_listp)) == NULL
-     || (ch_lines_list = rdparse_LINES_LIST(list, err_listp)) == NULL) {
-        tree_destroy(ch_line);
-        tree_destroy(ch_lines_list);
-        return NULL;
-    }
-
-    return make_treeN(PROD_PROGRAM, NULL, ch_line, ch_lines_list, NULL);
-}
-
-void errlist_destroy(struct parse_error *err_list)
-{
-    while (err_list != NULL) {
-        struct parse_error *next = err_list->next;
-
-        free(err_list->message);
-        free(err_list);
-        err_list = next;
-    }
+    return ll1_parse(arena, tokens, err_listp, true, NULL, NULL);
 }
 
-struct parse *rdparser(const struct llist *tokens, struct parse_error **err_listp)
+bool rdparser_listen(struct arena *arena, const struct llist *tokens,
+        struct parse_error **err_listp,
+        const struct parse_listener *listener, void *ctx)
 {
-    struct parse *tree;
-    const struct link *first_link;
-
-    first_link = tokens->head;
-
-    tree = rdparse_PROGRAM(&first_link, err_listp);
-
-    return tree;
+    return ll1_parse(arena, tokens, err_listp, false, listener, ctx) != NULL;
 }
 
 const char *category_names[] = {
@@ -673,16 +611,16 @@ int prstree_empty(struct parse *tree)
     return tree == NULL || (tree->type != PROD_TERMINAL && tree->lchild == NULL);
 }
 
-static void prstree_debug2(struct parse *parent, 
+static void prstree_debug_node(struct parse *parent,
         struct parse *tree, FILE *stream)
 {
     if (tree->token != NULL) {
         fprintf(stream, "node%p [label=\"%s\"];\n", tree,
                 category_names[tree->token->cat]);
         if (match_NAME(tree->token)) {
-            fprintf(stream, "node%p_str_data [label=\"%s\"];\n",
-                    tree, tree->token->str_data);
-            fprintf(stream, "node%p -> node%p_str_data;\n", tree, tree);
+            fprintf(stream, "node%p_text [label=\"%.*s\"];\n",
+                    tree, (int) tree->token->text.len, tree->token->text.data);
+            fprintf(stream, "node%p -> node%p_text;\n", tree, tree);
         }
     } else {
         fprintf(stream, "node%p [label=\"%s\"];\n", tree, 
@@ -690,15 +628,35 @@ static void prstree_debug2(struct parse *parent,
     }
     if (parent != NULL)
         fprintf(stream, "node%p -> node%p;\n", parent, tree);
+}
 
-    if (!prstree_empty(tree)) {
-        struct parse *child = tree->lchild;
+/**
+ * Walks the tree with an explicit stack, since a long
+ * program makes for a very deep tree.
+ */
+static void prstree_debug2(struct parse *tree, FILE *stream)
+{
+    struct parse_stack stack = { 0 };
+
+    /* the stack holds nodes whose children still have to be visited */
+    prstree_debug_node(NULL, tree, stream);
+    if (parse_stack_push(&stack, 0, tree) == -1)
+        return;
 
-        while (child != NULL) {
-            prstree_debug2(tree, child, stream);
-            child = child->rsibling;
+    while (stack.size != 0) {
+        struct parse *node = stack.items[--stack.size].node;
+
+        if (prstree_empty(node))
+            continue;
+
+        for (struct parse *child = node->lchild; child != NULL; child = child->rsibling) {
+            prstree_debug_node(node, child, stream);
+            if (parse_stack_push(&stack, 0, child) == -1)
+                break;
         }
     }
+
+    free(stack.items);
 }
 
 void prstree_debug(struct parse *tree)
@@ -714,7 +672,7 @@ void prstree_debug(struct parse *tree)
     stream = fopen(fname, "a");
     tmpnam(fname2);
     fprintf(stream, "digraph G {\n");
-    prstree_debug2(NULL, tree, stream);
+    prstree_debug2(tree, stream);
     fprintf(stream, "}");
 
     fclose(stream);
@@ -8,16 +8,32 @@
  */
 
 #include <stddef.h>
+#include <stdbool.h>
 #include "ds/llist.h"
+#include "ds/arena.h"
 
 /*** Tokenizer part ***/
 
+/**
+ * A view of {@len} bytes of text. The bytes are not NUL-terminated.
+ */
+struct span {
+    const char *data;
+    size_t len;
+};
+
+/**
+ * Makes a span out of a string literal.
+ */
+#define SPAN_LITERAL(str) ((struct span) { (str), sizeof(str) - 1 })
+
 /**
  * This is a token category.
  */
 enum tcat {
     /**
      * A string, like "...", with anything between two double-quotes, except for a newline.
+     * A string that runs into the end of the line is an error.
      */
     CAT_STRING_DBL,
     /**
@@ -77,30 +93,36 @@ struct token {
      */
     enum tcat cat;
     /**
-     * The string of the token.
+     * The text of the token. This points into the tokenized input,
+     * unless escape sequences had to be removed, in which case it
+     * points to an unescaped copy in the arena. For CAT_ERROR, this
+     * is the error message.
+     */
+    struct span text;
+    /**
+     * The token as it appears in the input, with any quotes and escapes.
      */
-    char *str_data;
-    /** The line number. **/
+    struct span raw;
+    /** The line number, counting from 1 at the start of the input. **/
     size_t lineno;
-    /** The character number on this line. **/
+    /** The character number on this line, counting from 0. **/
     size_t charno;
 };
 
 /**
- * Current total number of read lines.
- */
-extern size_t num_lines;
-
-/**
- * frees all memory allocated by a token.
- */
-void token_destroy(struct token *tk);
-
-/**
- * Returns a list of tokens.
+ * Returns a list of tokens for the text from *{@input} up to {@end}.
+ * The text may span many lines; each newline is a token, and nothing
+ * else (a string, or an escape) can continue past it. A NUL byte
+ * ends its line: the rest of the line is ignored.
+ * The list and the tokens are allocated from {@arena} and go away
+ * when it is reset.
  * Advances *{@input} right after the last token.
+ * *{@num_lines} is the number of lines before the text; tokens are
+ * numbered after it, and it is advanced past each newline.
+ * Returns NULL if the arena runs out of memory.
  */
-struct llist *tokenize(const char **input);
+struct llist *tokenize(struct arena *arena, const char **input, const char *end,
+        size_t *num_lines);
 
 /** end of tokenizer stuff **/
 
@@ -139,7 +161,7 @@ enum prod {
 
 /**
  * Represents a list of parse errors.
- * Use errlist_destroy() to clean up.
+ * The list lives in the arena given to rdparser().
  */
 struct parse_error {
     size_t lineno;
@@ -148,11 +170,6 @@ struct parse_error {
     struct parse_error *next;
 };
 
-/**
- * Frees all dynamically-allocated storage for a list of parse errors.
- */
-void errlist_destroy(struct parse_error *err_list);
-
 /**
  * A n-ary parse tree.
  */
@@ -166,18 +183,42 @@ struct parse {
     struct parse *rsibling;
 };
 
-/**
- * Frees all data allocated by a parse tree.
- * Does not free the tokens.
- */
-void tree_destroy(struct parse *tree);
-
 /**
  * Given input tokens, returns a parse tree.
  * If parsing failed, returns NULL and *{@err_listp} 
  * will point to a list of {struct parse_error}s.
+ * The tree and the errors are allocated from {@arena}; if it runs
+ * out of memory, returns NULL, possibly without any errors.
+ */
+struct parse *rdparser(struct arena *arena, const struct llist *tokens,
+        struct parse_error **err_listp);
+
+/**
+ * Receives the steps of a parse as they happen, for
+ * consumers that do not need a parse tree.
+ */
+struct parse_listener {
+    /**
+     * Called when {@prod} is expanded by a non-empty rule,
+     * before any of its symbols are matched. Productions that
+     * derive the empty string are not reported.
+     */
+    void (*expand)(void *ctx, enum prod prod);
+    /**
+     * Called when {@tk} is matched, in input order.
+     */
+    void (*token)(void *ctx, const struct token *tk);
+};
+
+/**
+ * Parses the tokens like rdparser(), but reports each step to
+ * {@listener} instead of building a tree. Returns false if parsing
+ * failed, in which case *{@err_listp} will point to the errors, or
+ * if the arena ran out of memory.
  */
-struct parse *rdparser(const struct llist *tokens, struct parse_error **err_listp);
+bool rdparser_listen(struct arena *arena, const struct llist *tokens,
+        struct parse_error **err_listp,
+        const struct parse_listener *listener, void *ctx);
 
 /**
  * Determines if a parse tree is empty.
@@ -0,0 +1,65 @@
+#include "pcfsh.h"
+
+/**
+ * Makes *{@err_listp} say that the arena of {@ctx} ran out of
+ * memory around line {@lineno}, unless there were other errors.
+ */
+static void pcfsh_out_of_memory(struct pcfsh_context *ctx, size_t lineno,
+        struct parse_error **err_listp)
+{
+    static char message[] = "Out of memory.";
+
+    if (*err_listp != NULL)
+        return;
+
+    ctx->out_of_memory = (struct parse_error) { .lineno = lineno, .message = message };
+    *err_listp = &ctx->out_of_memory;
+}
+
+void pcfsh_context_init(struct pcfsh_context *ctx, const struct arena_allocator *allocator)
+{
+    arena_init_allocator(&ctx->arena, 0, allocator);
+    ctx->num_lines = 0;
+}
+
+void pcfsh_context_reset(struct pcfsh_context *ctx)
+{
+    arena_reset(&ctx->arena);
+}
+
+void pcfsh_context_destroy(struct pcfsh_context *ctx)
+{
+    arena_destroy(&ctx->arena);
+}
+
+struct llist *pcfsh_tokenize(struct pcfsh_context *ctx, const char **input, const char *end)
+{
+    return tokenize(&ctx->arena, input, end, &ctx->num_lines);
+}
+
+struct parse *pcfsh_parse(struct pcfsh_context *ctx, const struct llist *tokens,
+        struct parse_error **err_listp)
+{
+    struct parse *tree = tokens != NULL ? rdparser(&ctx->arena, tokens, err_listp) : NULL;
+
+    if (tree == NULL)
+        pcfsh_out_of_memory(ctx, ctx->num_lines, err_listp);
+    return tree;
+}
+
+struct llist *pcfsh_analyze(struct pcfsh_context *ctx, struct parse *tree)
+{
+    return analyze_pipelines(&ctx->arena, tree);
+}
+
+struct llist *pcfsh_parse_text(struct pcfsh_context *ctx, const char *begin, const char *end,
+        struct parse_error **err_listp)
+{
+    size_t lineno = ctx->num_lines + 1;
+    struct llist *tokens = pcfsh_tokenize(ctx, &begin, end);
+    struct llist *pipelines = tokens != NULL ? analyze_tokens(&ctx->arena, tokens, err_listp) : NULL;
+
+    if (pipelines == NULL)
+        pcfsh_out_of_memory(ctx, lineno, err_listp);
+    return pipelines;
+}
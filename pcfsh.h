@@ -0,0 +1,80 @@
+#ifndef PCFSH_H
+#define PCFSH_H
+
+/**
+ * libpcfsh: the front end of the shell (tokenizer, parser and
+ * analyzer) as a library.
+ *
+ * There is no global state: everything lives in a {struct pcfsh_context},
+ * and everything a context allocates comes from the allocator it was
+ * set up with. Contexts are independent, so any number of threads can
+ * parse at once, each with its own context.
+ */
+
+#include "parser.h"
+#include "analyzer.h"
+#include "ds/arena.h"
+#include <stddef.h>
+
+struct pcfsh_context {
+    /**
+     * The tokens, trees, pipelines and errors of the context.
+     */
+    struct arena arena;
+    /**
+     * The number of lines tokenized so far. Tokens, pipelines
+     * and errors are numbered after it.
+     */
+    size_t num_lines;
+    /**
+     * The error for when the arena runs out of memory, which
+     * cannot come from the arena itself.
+     */
+    struct parse_error out_of_memory;
+};
+
+/**
+ * Sets up a context. Its memory comes from {@allocator}, or from
+ * malloc(3) if {@allocator} is NULL.
+ */
+void pcfsh_context_init(struct pcfsh_context *ctx, const struct arena_allocator *allocator);
+
+/**
+ * Frees everything the context has returned so far at once, keeping
+ * the memory for reuse. The line count is kept; set {@num_lines} to
+ * start over from another line.
+ */
+void pcfsh_context_reset(struct pcfsh_context *ctx);
+
+/**
+ * Gives all of the context's memory back to its allocator.
+ */
+void pcfsh_context_destroy(struct pcfsh_context *ctx);
+
+/**
+ * See tokenize().
+ */
+struct llist *pcfsh_tokenize(struct pcfsh_context *ctx, const char **input, const char *end);
+
+/**
+ * See rdparser(). If there is no memory for the tokens or the tree,
+ * the error says so.
+ */
+struct parse *pcfsh_parse(struct pcfsh_context *ctx, const struct llist *tokens,
+        struct parse_error **err_listp);
+
+/**
+ * See analyze_pipelines().
+ */
+struct llist *pcfsh_analyze(struct pcfsh_context *ctx, struct parse *tree);
+
+/**
+ * Tokenizes, parses and analyzes the text from {@begin} to {@end} in
+ * one pass, without building a parse tree. Returns the list of
+ * {struct an_pipeline}s, or NULL if there were errors, which are put
+ * in *{@err_listp}. Running out of memory is one of them.
+ */
+struct llist *pcfsh_parse_text(struct pcfsh_context *ctx, const char *begin, const char *end,
+        struct parse_error **err_listp);
+
+#endif
@@ -0,0 +1,330 @@
+#include "pparser.h"
+#include "analyzer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+
+/**
+ * How much text a thread takes at once. A chunk is
+ * extended to the end of the line it stops in.
+ */
+#define PPARSER_CHUNK (1024 * 1024)
+
+/**
+ * How many chunks per thread may be parsed ahead of the one
+ * being executed. This is what bounds the memory in use.
+ */
+#define PPARSER_AHEAD 2
+
+struct pparser_chunk {
+    const char *begin;
+    const char *end;
+    struct arena arena;
+    struct llist *pipelines;
+    struct parse_error *errors;
+    /** The number of lines in the chunk. **/
+    size_t num_lines;
+    bool done;
+    /**
+     * Where the pipelines of a chunk parsed line by line go, and the
+     * error for when the arena runs out of memory; neither can come
+     * from the arena itself.
+     */
+    struct llist lines;
+    struct parse_error out_of_memory;
+};
+
+struct pparser {
+    pthread_mutex_t lock;
+    /** Signalled when a chunk is done, or a slot is free. **/
+    pthread_cond_t cond;
+
+    /** Where the next chunk starts, and where the text ends. **/
+    const char *next;
+    const char *end;
+
+    /** A ring of slots, each holding one chunk. **/
+    struct pparser_chunk *chunks;
+    size_t num_chunks;
+    /**
+     * How many chunks have been started, handed back,
+     * and handed back and executed, freeing their slots.
+     */
+    size_t started;
+    size_t returned;
+    size_t released;
+
+    bool stop;
+    pthread_t *threads;
+    size_t num_threads;
+};
+
+/**
+ * Appends the list {@err} to the list at {@tailp}.
+ * Returns the new tail.
+ */
+static struct parse_error **errlist_concat(struct parse_error **tailp, struct parse_error *err)
+{
+    *tailp = err;
+    while (*tailp != NULL)
+        tailp = &(*tailp)->next;
+    return tailp;
+}
+
+/**
+ * Parses the text from {@begin} to {@end} into the arena of {@chunk}.
+ * Returns the pipelines, or NULL if there were errors, or if the arena
+ * ran out of memory.
+ */
+static struct llist *chunk_parse(struct pparser_chunk *chunk, const char *begin, const char *end,
+        struct parse_error **err_listp)
+{
+    struct llist *tokens = tokenize(&chunk->arena, &begin, end, &chunk->num_lines);
+
+    return tokens != NULL ? analyze_tokens(&chunk->arena, tokens, err_listp) : NULL;
+}
+
+/**
+ * Records that the line of {@chunk} at {@line} could not be parsed
+ * for lack of memory, and neither can anything after it, since the
+ * arena is not reset until the chunk has been executed.
+ */
+static void chunk_out_of_memory(struct pparser_chunk *chunk, const char *line,
+        size_t lineno, struct parse_error **err_tailp)
+{
+    static char message[] = "Out of memory.";
+
+    chunk->out_of_memory = (struct parse_error) { .lineno = lineno, .message = message };
+    *err_tailp = &chunk->out_of_memory;
+
+    /* the lines after it still count */
+    chunk->num_lines = lineno - 1;
+    for (; line < chunk->end && (line = memchr(line, '\n', chunk->end - line)) != NULL; ++line)
+        chunk->num_lines++;
+}
+
+/**
+ * Parses a chunk into its own arena. Like run_lines() in the shell,
+ * a chunk with errors is parsed again line by line, so that only the
+ * bad lines are lost.
+ */
+static void parse_chunk(struct pparser_chunk *chunk)
+{
+    struct parse_error **err_tailp = &chunk->errors;
+
+    chunk->num_lines = 0;
+    chunk->errors = NULL;
+    chunk->pipelines = chunk_parse(chunk, chunk->begin, chunk->end, &chunk->errors);
+
+    if (chunk->pipelines != NULL)
+        return;
+
+    arena_reset(&chunk->arena);
+    chunk->num_lines = 0;
+    chunk->errors = NULL;
+    chunk->lines = (struct llist) { .arena = &chunk->arena };
+    chunk->pipelines = &chunk->lines;
+
+    for (const char *p = chunk->begin; p < chunk->end; ) {
+        const char *nl = memchr(p, '\n', chunk->end - p);
+        const char *line_end = nl != NULL ? nl + 1 : chunk->end;
+        size_t lineno = chunk->num_lines + 1;
+        struct parse_error *err = NULL;
+        struct llist *pipelines = chunk_parse(chunk, p, line_end, &err);
+
+        if (err != NULL) {
+            err_tailp = errlist_concat(err_tailp, err);
+        } else if (pipelines == NULL) {
+            chunk_out_of_memory(chunk, p, lineno, err_tailp);
+            return;
+        } else {
+            size_t size = chunk->pipelines->size;
+
+            for (struct link *lnk = pipelines->head; lnk != NULL; lnk = lnk->next) {
+                if (list_append(chunk->pipelines, lnk->data) == -1) {
+                    /* none of the line's pipelines run, like with an error */
+                    while (chunk->pipelines->size > size)
+                        list_remove_end(chunk->pipelines);
+                    chunk_out_of_memory(chunk, p, lineno, err_tailp);
+                    return;
+                }
+            }
+        }
+
+        p = line_end;
+    }
+}
+
+/**
+ * Takes the next chunk of text into a free slot. Must be called with
+ * the lock held, and there must be both text left and a free slot.
+ */
+static struct pparser_chunk *pparser_take(struct pparser *pp)
+{
+    struct pparser_chunk *chunk = &pp->chunks[pp->started++ % pp->num_chunks];
+    const char *nl;
+
+    chunk->begin = pp->next;
+    chunk->end = pp->end;
+    if (pp->end - pp->next > PPARSER_CHUNK
+            && (nl = memchr(pp->next + PPARSER_CHUNK, '\n',
+                    pp->end - (pp->next + PPARSER_CHUNK))) != NULL)
+        chunk->end = nl + 1;
+    pp->next = chunk->end;
+
+    return chunk;
+}
+
+static void *pparser_thread(void *arg)
+{
+    struct pparser *pp = arg;
+
+    pthread_mutex_lock(&pp->lock);
+
+    for (;;) {
+        struct pparser_chunk *chunk;
+
+        /* wait for text to parse, and a slot to parse it into */
+        while (!pp->stop && pp->next < pp->end
+                && pp->started - pp->released == pp->num_chunks)
+            pthread_cond_wait(&pp->cond, &pp->lock);
+
+        if (pp->stop || pp->next == pp->end)
+            break;
+
+        chunk = pparser_take(pp);
+
+        pthread_mutex_unlock(&pp->lock);
+        parse_chunk(chunk);
+        pthread_mutex_lock(&pp->lock);
+
+        chunk->done = true;
+        pthread_cond_broadcast(&pp->cond);
+    }
+
+    pthread_mutex_unlock(&pp->lock);
+    return NULL;
+}
+
+struct pparser *pparser_new(const char *begin, const char *end, size_t num_threads,
+        const struct arena_allocator *allocator)
+{
+    struct pparser *pp = calloc(1, sizeof(*pp));
+    sigset_t all, mask;
+
+    if (pp == NULL) {
+        perror("calloc()");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_init(&pp->lock, NULL);
+    pthread_cond_init(&pp->cond, NULL);
+    pp->next = begin;
+    pp->end = end;
+
+    pp->num_chunks = PPARSER_AHEAD * num_threads;
+    pp->chunks = calloc(pp->num_chunks, sizeof(*pp->chunks));
+    pp->threads = calloc(num_threads, sizeof(*pp->threads));
+    if (pp->chunks == NULL || pp->threads == NULL) {
+        perror("calloc()");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < pp->num_chunks; ++i)
+        arena_init_allocator(&pp->chunks[i].arena, 0, allocator);
+
+    /* signals, SIGCHLD above all, are for the thread running the jobs */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &mask);
+    for (size_t i = 0; i < num_threads; ++i) {
+        int error = pthread_create(&pp->threads[i], NULL, pparser_thread, pp);
+
+        if (error != 0) {
+            /* make do with the threads we have */
+            fprintf(stderr, "pthread_create(): %s\n", strerror(error));
+            break;
+        }
+        pp->num_threads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+    return pp;
+}
+
+bool pparser_next(struct pparser *pp, struct llist **pipelines,
+        struct parse_error **errors, size_t *num_lines)
+{
+    struct pparser_chunk *chunk;
+
+    pthread_mutex_lock(&pp->lock);
+
+    /* the previous chunk has been executed, so its slot is free */
+    if (pp->released < pp->returned) {
+        chunk = &pp->chunks[pp->released++ % pp->num_chunks];
+        arena_reset(&chunk->arena);
+        chunk->done = false;
+        pthread_cond_broadcast(&pp->cond);
+    }
+
+    if (pp->returned == pp->started && pp->next == pp->end) {
+        pthread_mutex_unlock(&pp->lock);
+        return false;
+    }
+
+    /* without any thread, the text is parsed on this one */
+    if (pp->num_threads == 0) {
+        chunk = pparser_take(pp);
+        parse_chunk(chunk);
+        chunk->done = true;
+    }
+
+    chunk = &pp->chunks[pp->returned % pp->num_chunks];
+    while (pp->returned == pp->started || !chunk->done)
+        pthread_cond_wait(&pp->cond, &pp->lock);
+    pp->returned++;
+
+    pthread_mutex_unlock(&pp->lock);
+
+    /* the chunk was numbered from 1, now that we know what comes before it, renumber it */
+    for (struct link *lnk = chunk->pipelines->head; lnk != NULL; lnk = lnk->next)
+        ((struct an_pipeline *) lnk->data)->lineno += *num_lines;
+    for (struct parse_error *err = chunk->errors; err != NULL; err = err->next)
+        err->lineno += *num_lines;
+
+    *pipelines = chunk->pipelines;
+    *errors = chunk->errors;
+    *num_lines += chunk->num_lines;
+    return true;
+}
+
+bool pparser_done(struct pparser *pp)
+{
+    bool done;
+
+    pthread_mutex_lock(&pp->lock);
+    done = pp->returned == pp->started && pp->next == pp->end;
+    pthread_mutex_unlock(&pp->lock);
+
+    return done;
+}
+
+void pparser_destroy(struct pparser *pp)
+{
+    pthread_mutex_lock(&pp->lock);
+    pp->stop = true;
+    pthread_cond_broadcast(&pp->cond);
+    pthread_mutex_unlock(&pp->lock);
+
+    for (size_t i = 0; i < pp->num_threads; ++i)
+        pthread_join(pp->threads[i], NULL);
+
+    for (size_t i = 0; i < pp->num_chunks; ++i)
+        arena_destroy(&pp->chunks[i].arena);
+
+    pthread_cond_destroy(&pp->cond);
+    pthread_mutex_destroy(&pp->lock);
+    free(pp->chunks);
+    free(pp->threads);
+    free(pp);
+}
@@ -0,0 +1,50 @@
+#ifndef PPARSER_H
+#define PPARSER_H
+
+/**
+ * Tokenizes and parses a large text on a pool of threads.
+ *
+ * The text is split into chunks of whole lines. Since neither a string
+ * nor an escape can continue past a newline (see tokenize()), every
+ * newline is a safe place to split, and each chunk parses the same as
+ * it would as part of the whole. The chunks are handed back in order,
+ * so that they can be executed one after the other.
+ */
+
+#include "parser.h"
+#include "ds/llist.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+struct pparser;
+
+/**
+ * Starts {@num_threads} threads on the text from {@begin} to {@end}.
+ * The text must stay in place until pparser_destroy(). The results
+ * are allocated with {@allocator} (from the pool's threads),
+ * or malloc(3) if it is NULL.
+ */
+struct pparser *pparser_new(const char *begin, const char *end, size_t num_threads,
+        const struct arena_allocator *allocator);
+
+/**
+ * Waits for the next chunk of the text to be parsed. Gets its pipelines
+ * (a list of {struct an_pipeline}s) and the errors of the lines that
+ * could not be parsed. Both are numbered from *{@num_lines} + 1, and
+ * *num_lines is advanced past the chunk. They stay valid until the
+ * next call. Returns false when there is nothing left.
+ */
+bool pparser_next(struct pparser *pp, struct llist **pipelines,
+        struct parse_error **errors, size_t *num_lines);
+
+/**
+ * Whether the chunk that pparser_next() handed back last was the last one.
+ */
+bool pparser_done(struct pparser *pp);
+
+/**
+ * Stops the threads and frees everything.
+ */
+void pparser_destroy(struct pparser *pp);
+
+#endif
@@ -0,0 +1,360 @@
+#define _GNU_SOURCE
+#include "prefetch.h"
+#include "ds/htable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * How many programs can wait to be read ahead.
+ */
+#define PREFETCH_QUEUE 64
+
+#if __ELF_NATIVE_CLASS == 64
+#define ELFCLASS_NATIVE ELFCLASS64
+#else
+#define ELFCLASS_NATIVE ELFCLASS32
+#endif
+
+/**
+ * Where libraries are looked for. LD_LIBRARY_PATH and DT_RUNPATH are
+ * not, so some libraries may be missed, which only costs what it did
+ * before.
+ */
+static const char *const lib_dirs[] = {
+#if defined(__x86_64__)
+    "/lib/x86_64-linux-gnu",
+    "/usr/lib/x86_64-linux-gnu",
+#elif defined(__aarch64__)
+    "/lib/aarch64-linux-gnu",
+    "/usr/lib/aarch64-linux-gnu",
+#endif
+    "/lib64",
+    "/usr/lib64",
+    "/lib",
+    "/usr/lib",
+    NULL
+};
+
+struct prefetch_stats {
+    char *path;
+    /** How many times the program was read ahead. **/
+    unsigned runs;
+    /** How many files had pages that were not in memory. **/
+    unsigned files;
+    /** How much was not in memory. **/
+    size_t bytes;
+};
+
+/**
+ * Guards everything below, which the thread shares with the shell.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static bool started = false;
+
+/**
+ * A ring of paths waiting to be read ahead.
+ */
+static char *queue[PREFETCH_QUEUE];
+static size_t queue_head = 0;
+static size_t queue_len = 0;
+
+/**
+ * Maps paths to {struct prefetch_stats}, with the sums in {@total}.
+ */
+static struct htable *stats;
+static struct prefetch_stats total;
+
+/**
+ * Maps the file at {@path}, and reads ahead the pages of it that are not
+ * in memory, adding them to {@st}. Returns the mapping, of *{@sizep} bytes,
+ * or MAP_FAILED.
+ */
+static void *prefetch_map(const char *path, size_t *sizep, struct prefetch_stats *st)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    unsigned char *vec;
+    struct stat sb;
+    void *image;
+    size_t pages;
+    size_t missing = 0;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return MAP_FAILED;
+
+    if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode) || sb.st_size == 0
+            || (image = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return MAP_FAILED;
+    }
+
+    pages = (sb.st_size + page_size - 1) / page_size;
+    if ((vec = malloc(pages)) != NULL && mincore(image, sb.st_size, vec) == 0) {
+        for (size_t i = 0; i < pages; ++i)
+            missing += !(vec[i] & 1);
+    }
+    free(vec);
+
+    if (missing > 0) {
+        readahead(fd, 0, sb.st_size);
+        st->files++;
+        st->bytes += missing * page_size;
+    }
+
+    close(fd);
+    *sizep = sb.st_size;
+    return image;
+}
+
+/**
+ * Reads ahead a file that the program needs, without looking into it.
+ */
+static void prefetch_dep(const char *path, struct prefetch_stats *st)
+{
+    size_t size;
+    void *image = prefetch_map(path, &size, st);
+
+    if (image != MAP_FAILED)
+        munmap(image, size);
+}
+
+/**
+ * Finds the library {@name} the way the dynamic linker would by default.
+ */
+static void prefetch_lib(const char *name, struct prefetch_stats *st)
+{
+    char buf[PATH_MAX];
+
+    if (strchr(name, '/') != NULL) {
+        prefetch_dep(name, st);
+        return;
+    }
+
+    for (const char *const *dir = lib_dirs; *dir != NULL; ++dir) {
+        snprintf(buf, sizeof(buf), "%s/%s", *dir, name);
+        if (access(buf, R_OK) == 0) {
+            prefetch_dep(buf, st);
+            return;
+        }
+    }
+}
+
+/**
+ * Returns where the address {@vaddr} is in the file, or 0 if it is not in it.
+ */
+static size_t elf_offset(const ElfW(Phdr) *phdrs, size_t num_phdrs, ElfW(Addr) vaddr)
+{
+    for (size_t i = 0; i < num_phdrs; ++i) {
+        const ElfW(Phdr) *ph = &phdrs[i];
+
+        if (ph->p_type == PT_LOAD && vaddr >= ph->p_vaddr
+                && vaddr - ph->p_vaddr < ph->p_filesz)
+            return vaddr - ph->p_vaddr + ph->p_offset;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads ahead the interpreter and the libraries of the ELF file {@image}.
+ * Anything else, e.g. a script, needs nothing more.
+ */
+static void prefetch_elf(const unsigned char *image, size_t size, struct prefetch_stats *st)
+{
+    const ElfW(Ehdr) *eh = (const ElfW(Ehdr) *) image;
+    const ElfW(Phdr) *phdrs;
+    const ElfW(Dyn) *dyn = NULL;
+    size_t num_dyn = 0;
+    size_t strtab = 0;
+    size_t strsz = 0;
+
+    if (size < sizeof(*eh) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0
+            || eh->e_ident[EI_CLASS] != ELFCLASS_NATIVE
+            || eh->e_phentsize != sizeof(*phdrs)
+            || eh->e_phoff > size || eh->e_phnum > (size - eh->e_phoff) / sizeof(*phdrs))
+        return;
+    phdrs = (const ElfW(Phdr) *) (image + eh->e_phoff);
+
+    for (size_t i = 0; i < eh->e_phnum; ++i) {
+        const ElfW(Phdr) *ph = &phdrs[i];
+
+        if (ph->p_offset > size || ph->p_filesz > size - ph->p_offset)
+            continue;
+
+        if (ph->p_type == PT_INTERP) {
+            char interp[PATH_MAX];
+
+            snprintf(interp, sizeof(interp), "%.*s", (int) ph->p_filesz, image + ph->p_offset);
+            prefetch_dep(interp, st);
+        } else if (ph->p_type == PT_DYNAMIC) {
+            dyn = (const ElfW(Dyn) *) (image + ph->p_offset);
+            num_dyn = ph->p_filesz / sizeof(*dyn);
+        }
+    }
+
+    for (size_t i = 0; i < num_dyn && dyn[i].d_tag != DT_NULL; ++i) {
+        if (dyn[i].d_tag == DT_STRTAB)
+            strtab = elf_offset(phdrs, eh->e_phnum, dyn[i].d_un.d_ptr);
+        else if (dyn[i].d_tag == DT_STRSZ)
+            strsz = dyn[i].d_un.d_val;
+    }
+
+    if (strtab == 0 || strtab > size || strsz > size - strtab)
+        return;
+
+    for (size_t i = 0; i < num_dyn && dyn[i].d_tag != DT_NULL; ++i) {
+        const char *name = (const char *) image + strtab + dyn[i].d_un.d_val;
+
+        if (dyn[i].d_tag == DT_NEEDED && dyn[i].d_un.d_val < strsz
+                && memchr(name, '\0', strsz - dyn[i].d_un.d_val) != NULL)
+            prefetch_lib(name, st);
+    }
+}
+
+/**
+ * Reads ahead the program at {@path} and what it needs, and counts it.
+ */
+static void prefetch_program(const char *path)
+{
+    struct prefetch_stats st = { 0 };
+    struct prefetch_stats *entry;
+    size_t size;
+    void *image;
+
+    if ((image = prefetch_map(path, &size, &st)) == MAP_FAILED)
+        return;
+    prefetch_elf(image, size, &st);
+    munmap(image, size);
+
+    pthread_mutex_lock(&lock);
+    if ((entry = htable_get(stats, path)) == NULL && (entry = calloc(1, sizeof(*entry))) != NULL) {
+        if ((entry->path = strdup(path)) != NULL) {
+            htable_put(stats, entry->path, entry);
+        } else {
+            free(entry);
+            entry = NULL;
+        }
+    }
+    /* without the memory to list it, the program only counts in the total */
+    if (entry != NULL) {
+        entry->runs++;
+        entry->files += st.files;
+        entry->bytes += st.bytes;
+    }
+    total.runs++;
+    total.files += st.files;
+    total.bytes += st.bytes;
+    pthread_mutex_unlock(&lock);
+}
+
+static void *prefetch_main(void *arg)
+{
+    for (;;) {
+        char *path;
+
+        pthread_mutex_lock(&lock);
+        while (queue_len == 0)
+            pthread_cond_wait(&queue_cond, &lock);
+        path = queue[queue_head];
+        queue_head = (queue_head + 1) % PREFETCH_QUEUE;
+        queue_len--;
+        pthread_mutex_unlock(&lock);
+
+        prefetch_program(path);
+        free(path);
+    }
+
+    return NULL;
+}
+
+void prefetch_queue(const char *path)
+{
+    pthread_mutex_lock(&lock);
+
+    if (!started) {
+        pthread_attr_t attr;
+        pthread_t thread;
+        sigset_t all, mask;
+
+        stats = htable_new(htable_str_hash, htable_str_equals);
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        /* the thread inherits the mask: it must not take the shell's SIGCHLD */
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &mask);
+        started = pthread_create(&thread, &attr, prefetch_main, NULL) == 0;
+        pthread_sigmask(SIG_SETMASK, &mask, NULL);
+        pthread_attr_destroy(&attr);
+        if (!started) {
+            pthread_mutex_unlock(&lock);
+            return;
+        }
+    }
+
+    /* a program that is already waiting is not queued again */
+    for (size_t i = 0; i < queue_len; ++i) {
+        if (strcmp(queue[(queue_head + i) % PREFETCH_QUEUE], path) == 0) {
+            pthread_mutex_unlock(&lock);
+            return;
+        }
+    }
+
+    if (queue_len < PREFETCH_QUEUE
+            && (queue[(queue_head + queue_len) % PREFETCH_QUEUE] = strdup(path)) != NULL) {
+        queue_len++;
+        pthread_cond_signal(&queue_cond);
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+static void prefetch_report_entry(const void *key, void *value, void *ctx)
+{
+    const struct prefetch_stats *entry = value;
+
+    dprintf(*(int *) ctx, "%4u\t%u\t%zu\t%s\n", entry->runs, entry->files, entry->bytes, entry->path);
+}
+
+void prefetch_report(int fd)
+{
+    pthread_mutex_lock(&lock);
+
+    dprintf(fd, "prefetch: %u programs, %u files, %zu bytes read ahead\n",
+            total.runs, total.files, total.bytes);
+    if (stats != NULL && stats->size > 0) {
+        dprintf(fd, "runs\tfiles\tbytes\tprogram\n");
+        htable_foreach(stats, prefetch_report_entry, &fd);
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+static void stats_destroy(void *data)
+{
+    struct prefetch_stats *entry = data;
+
+    free(entry->path);
+    free(entry);
+}
+
+void prefetch_reset(void)
+{
+    pthread_mutex_lock(&lock);
+
+    if (stats != NULL)
+        htable_clear(stats, stats_destroy);
+    memset(&total, 0, sizeof(total));
+
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,31 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+/**
+ * Reads programs into the page cache ahead of running them.
+ *
+ * A thread of its own reads each program that is queued, along with
+ * its program interpreter (PT_INTERP) and the libraries it needs
+ * (DT_NEEDED), so that they are in memory by the time they are exec()d.
+ * Only the pages that were not already in memory are read, and they are
+ * counted for each program, to tell how much running it would have
+ * had to wait for the disk.
+ */
+
+/**
+ * Queues {@path} to be read ahead. If the queue is full, it is skipped;
+ * this is only ever an optimization.
+ */
+void prefetch_queue(const char *path);
+
+/**
+ * Writes how much has been read ahead, in all and for each program, to {@fd}.
+ */
+void prefetch_report(int fd);
+
+/**
+ * Forgets the counts.
+ */
+void prefetch_reset(void);
+
+#endif
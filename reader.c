@@ -0,0 +1,274 @@
+#define _GNU_SOURCE
+#include "reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define READER_BLOCK (64 * 1024)
+
+void reader_init(struct reader *reader, int fd)
+{
+    struct stat st;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = fd;
+    reader->peek_pipe[0] = reader->peek_pipe[1] = -1;
+    reader->capacity = READER_BLOCK;
+    reader->buf = malloc(reader->capacity);
+
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)
+            && pipe2(reader->peek_pipe, O_CLOEXEC) == 0)
+        reader->mode = READER_PIPE;
+    else if ((reader->fd_offset = lseek(fd, 0, SEEK_CUR)) != -1)
+        reader->mode = READER_SEEKABLE;
+    else
+        reader->mode = READER_STREAM;
+
+    reader->buf_offset = reader->fd_offset;
+}
+
+void reader_destroy(struct reader *reader)
+{
+    if (reader->peek_pipe[0] != -1) {
+        close(reader->peek_pipe[0]);
+        close(reader->peek_pipe[1]);
+    }
+    free(reader->buf);
+}
+
+/**
+ * Reads exactly {@len} bytes into {@buf}, unless the input ends first.
+ */
+static ssize_t read_full(int fd, char *buf, size_t len)
+{
+    size_t total = 0;
+
+    while (total < len) {
+        ssize_t n = read(fd, buf + total, len - total);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return total != 0 ? (ssize_t) total : -1;
+        if (n == 0)
+            break;
+        total += n;
+    }
+
+    return total;
+}
+
+/**
+ * Takes bytes up to buf[{@upto}] out of the pipe. We have already
+ * peeked at them, so they are read over the same bytes.
+ */
+static void pipe_consume(struct reader *reader, size_t upto)
+{
+    if (reader->mode != READER_PIPE || upto <= reader->consumed)
+        return;
+
+    read_full(reader->fd, reader->buf + reader->consumed, upto - reader->consumed);
+    reader->consumed = upto;
+}
+
+/**
+ * Returns true if the pipe still starts with buf[consumed, {@upto}),
+ * which we peeked at before running a command that could read it.
+ */
+static bool pipe_unchanged(struct reader *reader, size_t upto)
+{
+    size_t pos = reader->consumed;
+    char chunk[4096];
+    bool same = true;
+    ssize_t n;
+
+    if (upto == pos)
+        return true;
+
+    do
+        n = tee(reader->fd, reader->peek_pipe[1], upto - pos, SPLICE_F_NONBLOCK);
+    while (n < 0 && errno == EINTR);
+    if (n < (ssize_t) (upto - pos))
+        same = false;
+
+    /* the peek pipe has to be emptied either way */
+    while (n > 0) {
+        size_t want = (size_t) n < sizeof(chunk) ? (size_t) n : sizeof(chunk);
+        ssize_t len = read_full(reader->peek_pipe[0], chunk, want);
+
+        if (len <= 0)
+            return false;
+        if (same && memcmp(reader->buf + pos, chunk, len) != 0)
+            same = false;
+        pos += len;
+        n -= len;
+    }
+
+    return same;
+}
+
+/**
+ * Moves the unread input to the front of the buffer,
+ * and makes room for at least a block more.
+ */
+static void reader_compact(struct reader *reader)
+{
+    if (reader->start > 0) {
+        memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+        reader->buf_offset += reader->start;
+        reader->end -= reader->start;
+        reader->consumed -= reader->start;
+        reader->start = 0;
+    }
+
+    if (reader->capacity - reader->end < READER_BLOCK / 2) {
+        reader->capacity *= 2;
+        reader->buf = realloc(reader->buf, reader->capacity);
+    }
+}
+
+/**
+ * Reads more input into the buffer. Returns false at the end of the input.
+ */
+static bool reader_fill(struct reader *reader)
+{
+    ssize_t n;
+
+    reader_compact(reader);
+
+    switch (reader->mode) {
+        case READER_SEEKABLE:
+            if (reader->fd_offset != reader->buf_offset + (off_t) reader->end
+                    && lseek(reader->fd, reader->buf_offset + reader->end, SEEK_SET) == -1)
+                return false;
+            n = read_full(reader->fd, reader->buf + reader->end, reader->capacity - reader->end);
+            if (n <= 0)
+                return false;
+            reader->end += n;
+            reader->consumed = reader->end;
+            reader->fd_offset = reader->buf_offset + reader->end;
+            return true;
+
+        case READER_PIPE:
+            /* peek again from the head of the pipe */
+            reader->end = reader->consumed;
+            do
+                n = tee(reader->fd, reader->peek_pipe[1], reader->capacity - reader->end, 0);
+            while (n < 0 && errno == EINTR);
+
+            if (n < 0) {
+                /* we cannot peek at this pipe after all */
+                reader->mode = READER_STREAM;
+                return reader_fill(reader);
+            }
+            if (n == 0)
+                return false;
+
+            n = read_full(reader->peek_pipe[0], reader->buf + reader->end, n);
+            reader->end += n;
+
+            /* without a newline, none of this is beyond the current line,
+             * and the pipe has to be emptied for tee() to wait for more */
+            if (memchr(reader->buf + reader->end - n, '\n', n) == NULL)
+                pipe_consume(reader, reader->end);
+            return true;
+
+        case READER_STREAM:
+            do {
+                n = read_full(reader->fd, reader->buf + reader->end, 1);
+                if (n <= 0)
+                    return false;
+                reader->consumed = ++reader->end;
+            } while (reader->buf[reader->end - 1] != '\n' && reader->end < reader->capacity);
+            return true;
+    }
+
+    return false;
+}
+
+bool reader_next(struct reader *reader, const char **begin, const char **end)
+{
+    const char *nl = NULL;
+
+    /* the previous block is done */
+    pipe_consume(reader, reader->block_end);
+    reader->start = reader->block_end;
+
+    while (!reader->eof) {
+        const char *data = reader->buf + reader->start;
+        size_t len = reader->end - reader->start;
+
+        /* as many lines as we have; a stream only ever has one */
+        if ((nl = memrchr(data, '\n', len)) != NULL)
+            break;
+
+        if (!reader_fill(reader))
+            reader->eof = true;
+    }
+
+    if (nl != NULL)
+        reader->block_end = nl + 1 - reader->buf;
+    else if (reader->end > reader->start)
+        reader->block_end = reader->end;
+    else
+        return false;
+
+    *begin = reader->buf + reader->start;
+    *end = reader->buf + reader->block_end;
+    return true;
+}
+
+void reader_sync(struct reader *reader, const char *pos)
+{
+    size_t upto = pos - reader->buf;
+    off_t target;
+
+    switch (reader->mode) {
+        case READER_SEEKABLE:
+            target = reader->buf_offset + upto;
+            if (reader->fd_offset != target && lseek(reader->fd, target, SEEK_SET) != -1)
+                reader->fd_offset = target;
+            break;
+        case READER_PIPE:
+            pipe_consume(reader, upto);
+            break;
+        case READER_STREAM:
+            break;
+    }
+}
+
+bool reader_after_job(struct reader *reader)
+{
+    off_t offset;
+
+    switch (reader->mode) {
+        case READER_SEEKABLE:
+            offset = lseek(reader->fd, 0, SEEK_CUR);
+            if (offset == -1 || offset == reader->fd_offset)
+                return false;
+
+            /* the command read some of the input, so start over from where it stopped */
+            reader->start = reader->end = reader->block_end = reader->consumed = 0;
+            reader->buf_offset = reader->fd_offset = offset;
+            reader->eof = false;
+            return true;
+        case READER_PIPE:
+            /* what lies past the block is peeked at again anyway */
+            if (pipe_unchanged(reader, reader->block_end)) {
+                reader->end = reader->block_end;
+                return false;
+            }
+
+            /* the command read some of the block, so peek again from where it stopped */
+            reader->end = reader->block_end = reader->consumed;
+            return true;
+        case READER_STREAM:
+            break;
+    }
+
+    return false;
+}
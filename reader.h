@@ -0,0 +1,91 @@
+#ifndef READER_H
+#define READER_H
+
+/**
+ * Reads non-interactive input in blocks of whole lines.
+ *
+ * Commands run by the shell inherit its input, and may read from it.
+ * The reader makes sure that whenever such a command starts, the
+ * input is positioned right after the line the command came from:
+ * - if the input is seekable, it is read in large blocks, and the
+ *   file offset is moved back before each command that could read it;
+ * - if it is a pipe, the reader only peeks at it (see tee(2)), takes
+ *   it out of the pipe up to each command that could read it, and
+ *   after the command, checks that the rest of the block is still
+ *   what the pipe starts with;
+ * - otherwise, it is read one byte at a time up to each newline.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+enum reader_mode {
+    READER_SEEKABLE,
+    READER_PIPE,
+    READER_STREAM
+};
+
+struct reader {
+    int fd;
+    enum reader_mode mode;
+    bool eof;
+
+    char *buf;
+    size_t capacity;
+    /**
+     * buf[start, end) holds the input that has not been run yet.
+     */
+    size_t start;
+    size_t end;
+    /**
+     * Where the block returned by reader_next() ends.
+     */
+    size_t block_end;
+
+    /**
+     * READER_SEEKABLE: the file offset of buf[0],
+     * and the offset the file is actually at.
+     */
+    off_t buf_offset;
+    off_t fd_offset;
+
+    /**
+     * buf[start, consumed) has been read from the input. With READER_PIPE,
+     * buf[consumed, end) has only been peeked at and is still in the pipe.
+     */
+    size_t consumed;
+    int peek_pipe[2];
+};
+
+/**
+ * Sets up a reader for {@fd}.
+ */
+void reader_init(struct reader *reader, int fd);
+
+/**
+ * Frees the reader's buffers. Does not close its fd.
+ */
+void reader_destroy(struct reader *reader);
+
+/**
+ * Gets the next block of complete lines into [*{@begin}, *{@end}).
+ * The last line of the input may lack a newline. The block stays
+ * valid until the next call. Returns false at the end of the input.
+ */
+bool reader_next(struct reader *reader, const char **begin, const char **end);
+
+/**
+ * Must be called before running a command that may read the input.
+ * {@pos} is the end of the command's line, within the current block.
+ */
+void reader_sync(struct reader *reader, const char *pos);
+
+/**
+ * Must be called after running a command that may read the input.
+ * Returns true if the command did consume input from the current
+ * block, in which case the rest of it is stale and must not be run.
+ */
+bool reader_after_job(struct reader *reader);
+
+#endif
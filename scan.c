@@ -0,0 +1,216 @@
+#include "scan.h"
+
+/* SSE2 is the baseline; AVX2 is picked at runtime */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+#define ARG_STOP (SCAN_SPACE | SCAN_NEWLINE | SCAN_OP | SCAN_BACKSLASH | SCAN_NUL)
+
+const unsigned char scan_table[256] = {
+    ['\0'] = SCAN_NUL,
+    ['\t'] = SCAN_SPACE,
+    ['\n'] = SCAN_NEWLINE,
+    ['\v'] = SCAN_SPACE,
+    ['\f'] = SCAN_SPACE,
+    ['\r'] = SCAN_SPACE,
+    [' '] = SCAN_SPACE,
+    ['|'] = SCAN_OP,
+    ['&'] = SCAN_OP,
+    ['<'] = SCAN_OP,
+    ['>'] = SCAN_OP,
+    [';'] = SCAN_OP,
+    ['"'] = SCAN_QUOTE,
+    ['\''] = SCAN_QUOTE,
+    ['\\'] = SCAN_BACKSLASH
+};
+
+static size_t scan_arg_scalar(const char *p, const char *end, bool *has_slash)
+{
+    const char *start = p;
+
+    while (p < end && !scan_is(*p, ARG_STOP)) {
+        if (*p == '/')
+            *has_slash = true;
+        ++p;
+    }
+
+    return p - start;
+}
+
+static size_t scan_string_scalar(const char *p, const char *end, char delim)
+{
+    const char *start = p;
+
+    while (p < end && *p != delim && *p != '\\' && *p != '\n' && *p != '\0')
+        ++p;
+
+    return p - start;
+}
+
+#ifdef SCAN_X86
+/**
+ * Sets a bit in the result for every byte of {@x} that stops an argument.
+ */
+static inline unsigned arg_stops_sse2(__m128i x)
+{
+    /* \t, \n, \v, \f and \r are the five bytes from 0x09 to 0x0d */
+    __m128i ctrl = _mm_sub_epi8(x, _mm_set1_epi8(0x09));
+    __m128i m = _mm_cmpeq_epi8(_mm_max_epu8(ctrl, _mm_set1_epi8(4)), _mm_set1_epi8(4));
+
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('|')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('&')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('<')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('>')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(';')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_setzero_si128()));
+
+    return (unsigned) _mm_movemask_epi8(m);
+}
+
+static size_t scan_arg_sse2(const char *p, const char *end, bool *has_slash)
+{
+    const char *start = p;
+
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) p);
+        unsigned stops = arg_stops_sse2(x);
+        unsigned slashes = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('/')));
+
+        if (stops != 0) {
+            unsigned n = __builtin_ctz(stops);
+
+            if (slashes & ((1u << n) - 1))
+                *has_slash = true;
+            return p + n - start;
+        }
+        if (slashes != 0)
+            *has_slash = true;
+        p += 16;
+    }
+
+    return p - start + scan_arg_scalar(p, end, has_slash);
+}
+
+static size_t scan_string_sse2(const char *p, const char *end, char delim)
+{
+    const char *start = p;
+
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) p);
+        __m128i m = _mm_cmpeq_epi8(x, _mm_set1_epi8(delim));
+        unsigned stops;
+
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_setzero_si128()));
+        stops = (unsigned) _mm_movemask_epi8(m);
+        if (stops != 0)
+            return p + __builtin_ctz(stops) - start;
+        p += 16;
+    }
+
+    return p - start + scan_string_scalar(p, end, delim);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned arg_stops_avx2(__m256i x)
+{
+    __m256i ctrl = _mm256_sub_epi8(x, _mm256_set1_epi8(0x09));
+    __m256i m = _mm256_cmpeq_epi8(_mm256_max_epu8(ctrl, _mm256_set1_epi8(4)), _mm256_set1_epi8(4));
+
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('|')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('&')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('<')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('>')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(';')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_setzero_si256()));
+
+    return (unsigned) _mm256_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_arg_avx2(const char *p, const char *end, bool *has_slash)
+{
+    const char *start = p;
+
+    while (end - p >= 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) p);
+        unsigned stops = arg_stops_avx2(x);
+        unsigned slashes = (unsigned) _mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(x, _mm256_set1_epi8('/')));
+
+        if (stops != 0) {
+            unsigned n = __builtin_ctz(stops);
+
+            if (slashes & ((1u << n) - 1))
+                *has_slash = true;
+            return p + n - start;
+        }
+        if (slashes != 0)
+            *has_slash = true;
+        p += 32;
+    }
+
+    return p - start + scan_arg_sse2(p, end, has_slash);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_string_avx2(const char *p, const char *end, char delim)
+{
+    const char *start = p;
+
+    while (end - p >= 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) p);
+        __m256i m = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(delim));
+        unsigned stops;
+
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_setzero_si256()));
+        stops = (unsigned) _mm256_movemask_epi8(m);
+        if (stops != 0)
+            return p + __builtin_ctz(stops) - start;
+        p += 32;
+    }
+
+    return p - start + scan_string_sse2(p, end, delim);
+}
+#endif
+
+static size_t (*scan_arg_impl)(const char *, const char *, bool *) = scan_arg_scalar;
+static size_t (*scan_string_impl)(const char *, const char *, char) = scan_string_scalar;
+
+/**
+ * Picks the widest implementation the CPU supports. This runs
+ * before main(), so there is no race on the function pointers.
+ */
+__attribute__((constructor))
+static void scan_init(void)
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_arg_impl = scan_arg_avx2;
+        scan_string_impl = scan_string_avx2;
+    } else {
+        scan_arg_impl = scan_arg_sse2;
+        scan_string_impl = scan_string_sse2;
+    }
+#endif
+}
+
+size_t scan_arg(const char *p, const char *end, bool *has_slash)
+{
+    return scan_arg_impl(p, end, has_slash);
+}
+
+size_t scan_string(const char *p, const char *end, char delim)
+{
+    return scan_string_impl(p, end, delim);
+}
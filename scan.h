@@ -0,0 +1,55 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+/**
+ * Byte classification for the tokenizer. The run scanners
+ * look at 16 (SSE2) or 32 (AVX2) bytes at a time where the CPU
+ * supports it, and fall back to a table lookup per byte otherwise.
+ * All implementations give the same results.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+enum scan_class {
+    /**
+     * Whitespace other than newline, as isspace() sees it in the C locale.
+     */
+    SCAN_SPACE = 1 << 0,
+    SCAN_NEWLINE = 1 << 1,
+    /**
+     * One of "|", "&", "<", ">", or ";".
+     */
+    SCAN_OP = 1 << 2,
+    SCAN_QUOTE = 1 << 3,
+    SCAN_BACKSLASH = 1 << 4,
+    SCAN_NUL = 1 << 5
+};
+
+/**
+ * The classes of every byte value.
+ */
+extern const unsigned char scan_table[256];
+
+/**
+ * Returns true if {@c} belongs to any of {@classes}.
+ */
+static inline bool scan_is(char c, unsigned classes)
+{
+    return (scan_table[(unsigned char) c] & classes) != 0;
+}
+
+/**
+ * Returns the number of bytes at {@p}, but not past {@end}, before
+ * the first whitespace, newline, operator, backslash or NUL byte.
+ * Sets *{@has_slash} if there is a '/' among them.
+ */
+size_t scan_arg(const char *p, const char *end, bool *has_slash);
+
+/**
+ * Returns the number of bytes at {@p}, but not past {@end}, before
+ * the first {@delim}, backslash, newline or NUL byte.
+ */
+size_t scan_string(const char *p, const char *end, char delim);
+
+#endif
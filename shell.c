@@ -1,6 +1,14 @@
+#define _GNU_SOURCE
 #include "shell.h"
+#include "spawn.h"
+#include "cmdhash.h"
+#include "zygote.h"
+#include "prefetch.h"
+#include "batch.h"
 #include "ds/llist.h"
+#include "ds/htable.h"
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
@@ -11,17 +19,100 @@
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <errno.h>
-#include <libgen.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/signalfd.h>
 #include <assert.h>
 
+/**
+ * glibc 2.36 has pidfd_open() and pidfd_send_signal().
+ */
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 36)
+#define HAVE_PIDFD
+#include <sys/pidfd.h>
+#endif
+
 /**
  * The process group ID of the shell.
  */
 pid_t shell_pgid;
 static int interactive = 0;
 static int shell_input_fd;
+/* whether to start the helper of zygote.h */
+static bool use_zygote = false;
+
+/**
+ * An option that the set builtin turns on and off.
+ */
+struct shell_option {
+    const char *name;
+    bool *value;
+};
+
+/* read programs ahead of running them, see jobs_prefetch() */
+static bool opt_prefetch = false;
+/* split commands that are too long for exec(), see job_batch_start() */
+static bool opt_autobatch = false;
+
+static struct shell_option options[] = {
+    { "prefetch", &opt_prefetch },
+    { "autobatch", &opt_autobatch },
+    { NULL, NULL }
+};
+
+/**
+ * The jobs with a state change that jobs_notifications() has yet to
+ * look at, oldest first, linked through their next field.
+ */
+static struct job *dirty_jobs = NULL;
+static struct job **dirty_tail = &dirty_jobs;
+
+/**
+ * The background jobs that wait for others to finish, see set -j,
+ * oldest first, linked through their next_queued field.
+ */
+static struct job *queued_jobs = NULL;
+static struct job **queued_tail = &queued_jobs;
+
+/**
+ * How many background jobs may run at once: 0 for any number, and -1
+ * until it is first needed, when it becomes the number of CPUs. And
+ * how many do, stopped ones included.
+ */
+static long max_bg_jobs = -1;
+static size_t num_bg_jobs = 0;
+
+/* the jobs that %+ and %- refer to, see job_make_current() */
+static struct job *cur_job = NULL;
+static struct job *prev_job = NULL;
+
+/**
+ * All the jobs, by their id, less one, and the lowest slot that may be free.
+ */
+static struct job **job_slots = NULL;
+static size_t num_job_slots = 0;
+static size_t job_slots_free = 0;
+
+/**
+ * The processes of the jobs, by PID, so that proc_update() does not
+ * have to look through every job. See proc_index().
+ */
+static struct htable *procs_by_pid = NULL;
+#define PID_KEY(pid) ((const void *) (intptr_t) (pid))
 
-static struct job *jobs = NULL;
+/* see pcfsh_status() */
+static int last_status = 0;
+
+/**
+ * The shell's current directory, kept open so that relative paths are
+ * resolved without looking it up again, and its path, for the prompt.
+ * Both are only found when first needed, and kept by cd. Past PATH_MAX,
+ * the path is only the directory's name.
+ */
+static int cwd_fd = -1;
+static char *cwd_path = NULL;
+/* SIGCHLD, for job_wait_change() */
+static int chld_fd = -1;
 static struct termios term_attrs;
 
 /**
@@ -60,6 +151,14 @@ static int proc_internal_cmd_fg(char **argv, int infile, int outfile);
 static int proc_internal_cmd_bg(char **argv, int infile, int outfile);
 static int proc_internal_cmd_exit(char **argv, int infile, int outfile);
 static int proc_internal_cmd_help(char **argv, int infile, int outfile);
+static int proc_internal_cmd_hash(char **argv, int infile, int outfile);
+static int proc_internal_cmd_set(char **argv, int infile, int outfile);
+static int proc_internal_cmd_prefetch(char **argv, int infile, int outfile);
+static intproc proc_internal_get(const char *cmdname);
+static bool proc_internal_exists(const char *cmdname);
+static int proc_update(pid_t pid, int status);
+static int job_wait_change(struct job *jb);
+static int job_start(struct job *jb);
 
 struct builtin builtins[] = {
     {
@@ -98,27 +197,42 @@ struct builtin builtins[] = {
         .usage = "help",
         .desc = "Show help."
     },
+    {
+        .name = "hash",
+        .func = proc_internal_cmd_hash,
+        .usage = "hash [-r] [-d name] [-p path name] [name...]",
+        .desc = "Show, forget (-r), or remember where commands are."
+    },
+    {
+        .name = "set",
+        .func = proc_internal_cmd_set,
+        .usage = "set [-o|+o option] [-j jobs]",
+        .desc = "Show the options, turn one on (-o) or off (+o), or limit background jobs (-j)."
+    },
+    {
+        .name = "prefetch",
+        .func = proc_internal_cmd_prefetch,
+        .usage = "prefetch [-r]",
+        .desc = "Show, or forget (-r), how much was read ahead for each program."
+    },
+    {
+        .name = "batch",
+        /* its chunks are processes of the job, see job_batch_start() */
+        .func = NULL,
+        .usage = "batch [-n args] [-s size] [-P procs] command [fixed args... --] [args...]",
+        .desc = "Run a command with too many arguments in pieces, like xargs."
+    },
     { NULL, NULL, NULL }
 };
 
-/*
-static void sighandler(int signum, siginfo_t *info, void *context)
-{
-    if (signum == SIGCHLD) {
-        if (info->si_code != CLD_CONTINUED) {
-        }
-    }
-}
-*/
-
 /**
  * Note: some of the basic ideas come from this helpful resource:
  * https://www.gnu.org/software/libc/manual/html_node/Initializing-the-Shell.html#Initializing-the-Shell
  */
-void pcfsh_init(void)
+void pcfsh_init(bool use_tty)
 {
     shell_input_fd = STDIN_FILENO;
-    interactive = isatty(shell_input_fd);
+    interactive = use_tty && isatty(shell_input_fd);
 
     /* determine if shell is running in a tty,
      * in case we want to register signal handlers */
@@ -154,25 +268,98 @@ void pcfsh_init(void)
         /* save terminal attributes */
         tcgetattr(shell_input_fd, &term_attrs);
 
-        /* register signal handler */
-        /*
-        struct sigaction sa;
-
-        sa.sa_sigaction = sighandler;
-        sigemptyset(&sa.sa_mask);
-        sa.sa_flags = SA_RESTART | SA_SIGINFO;
-
-        sigaction(SIGCHLD, &sa, NULL);
-        */
+        /* SIGCHLD is read from a signalfd by the
+         * loop that waits for input, see main.c */
 
         /* cleanup all jobs on exit */
         atexit(&jobs_cleanup);
     }
+
+    /* forked last, so that it has the signal dispositions set above */
+    if (use_zygote && zygote_start() == -1)
+        fprintf(stderr, "pcfsh: starting programs without a helper\n");
+}
+
+void pcfsh_use_zygote(bool value)
+{
+    use_zygote = value;
+}
+
+bool pcfsh_interactive(void)
+{
+    return interactive;
+}
+
+int pcfsh_status(void)
+{
+    return last_status;
+}
+
+/**
+ * Returns the descriptor of the current directory, for openat(),
+ * or AT_FDCWD if it could not be opened.
+ */
+static int cwd_dirfd(void)
+{
+    if (cwd_fd == -1)
+        cwd_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    return cwd_fd != -1 ? cwd_fd : AT_FDCWD;
+}
+
+/**
+ * Returns the name of the directory {@fd} in its parent, or NULL if
+ * it cannot be found there. Unlike a path worked out from what was
+ * given to cd, this follows the directories as they are, symbolic
+ * links and all.
+ */
+static char *dir_name(int fd)
+{
+    struct dirent *ent;
+    struct stat st;
+    char *name = NULL;
+    DIR *dir;
+    int parent;
+
+    if (fstat(fd, &st) == -1
+            || (parent = openat(fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return NULL;
+    if ((dir = fdopendir(parent)) == NULL) {
+        close(parent);
+        return NULL;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        struct stat ent_st;
+
+        /* the inode in the entry is enough to rule it out, but only stat() can tell */
+        if (ent->d_ino != st.st_ino || strcmp(ent->d_name, ".") == 0
+                || strcmp(ent->d_name, "..") == 0)
+            continue;
+        if (fstatat(parent, ent->d_name, &ent_st, AT_SYMLINK_NOFOLLOW) == 0
+                && ent_st.st_dev == st.st_dev && ent_st.st_ino == st.st_ino) {
+            name = strdup(ent->d_name);
+            break;
+        }
+    }
+
+    closedir(dir);
+    return name;
+}
+
+/**
+ * Returns the path of the current directory, or just its name past
+ * PATH_MAX (see cd), or NULL if it is not known.
+ */
+static const char *cwd_get(void)
+{
+    if (cwd_path == NULL)
+        cwd_path = getcwd(NULL, 0);
+    return cwd_path;
 }
 
 void pcfsh_prefix(const char *str)
 {
-    char cwd[1024];
+    const char *cwd;
     char buf[1024];
 
     if (!interactive)
@@ -181,8 +368,10 @@ void pcfsh_prefix(const char *str)
     if (str == NULL)
         str = "$";
 
-    if (getcwd(cwd, sizeof(cwd)) != NULL) {
-        char *bname = basename(cwd);
+    if ((cwd = cwd_get()) != NULL) {
+        const char *bname = strrchr(cwd, '/');
+
+        bname = bname != NULL && bname[1] != '\0' ? bname + 1 : cwd;
         snprintf(buf, sizeof(buf), "\x1b[38;5;32;1m%s\x1b[0m %s ", bname, str);
     } else
         snprintf(buf, sizeof(buf), "%s ", str);
@@ -194,19 +383,344 @@ void pcfsh_prefix(const char *str)
 
 static int proc_internal_cmd_cd(char **argv, int infile, int outfile)
 {
-    if (argv[1] != NULL) {
-        if (chdir(argv[1]) < 0) {
-            perror(argv[1]);
-            return -1;
-        }
+    char *path;
+    int fd;
+
+    if (argv[1] == NULL)
+        return 0;
+
+    /* relative to the directory we have, however deep it is */
+    if ((fd = openat(cwd_dirfd(), argv[1], O_PATH | O_DIRECTORY | O_CLOEXEC)) == -1
+            || fchdir(fd) == -1) {
+        perror(argv[1]);
+        if (fd != -1)
+            close(fd);
+        return -1;
     }
+
+    if (cwd_fd != -1)
+        close(cwd_fd);
+    cwd_fd = fd;
+
+    /* getcwd() fails past PATH_MAX, where the prompt makes do with the name */
+    if ((path = getcwd(NULL, 0)) == NULL)
+        path = dir_name(fd);
+    free(cwd_path);
+    cwd_path = path;
+
     return 0;
 }
 
+static size_t pid_hash(const void *key)
+{
+    /* PIDs are handed out in order, so their low bits are spread already */
+    return (size_t) (intptr_t) key;
+}
+
+static bool pid_equals(const void *key1, const void *key2)
+{
+    return key1 == key2;
+}
+
+/**
+ * Adds the started process {@p} to the index that proc_update() looks
+ * its PID up in.
+ */
+static void proc_index(struct proc *p)
+{
+    if (procs_by_pid == NULL)
+        procs_by_pid = htable_new(pid_hash, pid_equals);
+    htable_put(procs_by_pid, PID_KEY(p->pid), p);
+}
+
+/**
+ * Removes {@p} from the index, unless its PID went to a newer process.
+ */
+static void proc_unindex(struct proc *p)
+{
+    if (procs_by_pid != NULL && htable_get(procs_by_pid, PID_KEY(p->pid)) == p)
+        htable_remove(procs_by_pid, PID_KEY(p->pid));
+}
+
+/**
+ * Makes {@jb} the job that %+ refers to, and the one that was %-.
+ */
+static void job_make_current(struct job *jb)
+{
+    if (jb == cur_job)
+        return;
+    prev_job = cur_job;
+    cur_job = jb;
+}
+
+/**
+ * Picks the jobs for %+ and %- when they are gone: the ones with the
+ * highest ids.
+ */
+static void job_pick_current(void)
+{
+    for (size_t i = num_job_slots; i > 0 && (cur_job == NULL || prev_job == NULL); --i) {
+        struct job *jb = job_slots[i - 1];
+
+        if (jb == NULL || jb == cur_job || jb == prev_job)
+            continue;
+        if (cur_job == NULL)
+            cur_job = jb;
+        else
+            prev_job = jb;
+    }
+}
+
+/**
+ * Puts {@jb} on the list of jobs for jobs_notifications() to look at,
+ * if it is not there yet.
+ */
+static void job_mark_dirty(struct job *jb)
+{
+    if (jb->pprev != NULL)
+        return;
+    jb->next = NULL;
+    jb->pprev = dirty_tail;
+    *dirty_tail = jb;
+    dirty_tail = &jb->next;
+}
+
+/**
+ * Takes {@jb} off the list of jobs with state changes, if it is there.
+ */
+static void job_unmark_dirty(struct job *jb)
+{
+    if (jb->pprev == NULL)
+        return;
+    *jb->pprev = jb->next;
+    if (jb->next != NULL)
+        jb->next->pprev = jb->pprev;
+    else
+        dirty_tail = jb->pprev;
+    jb->next = NULL;
+    jb->pprev = NULL;
+}
+
+/**
+ * Records that {@p} has stopped or continued, in its job's counts.
+ */
+static void proc_set_stopped(struct proc *p, bool stopped)
+{
+    if (p->stopped == stopped)
+        return;
+    p->stopped = stopped;
+    if (stopped)
+        p->job->num_stopped++;
+    else
+        p->job->num_stopped--;
+}
+
+/**
+ * Records that {@p} has finished, in its job's counts.
+ */
+static void proc_set_finished(struct proc *p)
+{
+    if (p->finished)
+        return;
+    proc_set_stopped(p, false);
+    p->finished = true;
+    p->job->num_finished++;
+
+    if (p->pidfd != -1) {
+        close(p->pidfd);
+        p->pidfd = -1;
+    }
+}
+
+/**
+ * Sends {@sig} to {@p}, through its pidfd if it has one.
+ */
+static int proc_kill(const struct proc *p, int sig)
+{
+#ifdef HAVE_PIDFD
+    if (p->pidfd != -1)
+        return pidfd_send_signal(p->pidfd, sig, NULL, 0);
+#endif
+    return kill(p->pid, sig);
+}
+
+/**
+ * Sends {@sig} to {@jb}: to its process group if it has one, which also
+ * takes in whatever its processes started, or else to each process.
+ */
+static int job_kill(const struct job *jb, int sig)
+{
+    int ret = 0;
+
+    if (jb->pgid != 0)
+        return kill(-jb->pgid, sig);
+
+    for (struct proc *p = jb->procs; p != NULL; p = p->next) {
+        if (p->pid != 0 && !p->finished && proc_kill(p, sig) == -1)
+            ret = -1;
+    }
+    return ret;
+}
+
+/**
+ * Returns how many background jobs may run at once, see set -j.
+ */
+static long bg_limit(void)
+{
+    if (max_bg_jobs == -1)
+        max_bg_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_bg_jobs < 0)
+        max_bg_jobs = 0;
+    return max_bg_jobs;
+}
+
+/**
+ * Returns true if as many background jobs run as set -j allows.
+ */
+static bool bg_limit_reached(void)
+{
+    return bg_limit() > 0 && num_bg_jobs >= (size_t) bg_limit();
+}
+
+/**
+ * Counts {@jb} as a running background job.
+ */
+static void job_count(struct job *jb)
+{
+    if (!jb->counted) {
+        jb->counted = true;
+        num_bg_jobs++;
+    }
+}
+
+/**
+ * Stops counting {@jb} as a running background job.
+ */
+static void job_uncount(struct job *jb)
+{
+    if (jb->counted) {
+        jb->counted = false;
+        num_bg_jobs--;
+    }
+}
+
+/**
+ * Takes {@jb} out of the queue of background jobs.
+ */
+static void job_dequeue(struct job *jb)
+{
+    struct job **jbp = &queued_jobs;
+
+    while (*jbp != jb)
+        jbp = &(*jbp)->next_queued;
+    *jbp = jb->next_queued;
+    if (queued_tail == &jb->next_queued)
+        queued_tail = jbp;
+
+    jb->next_queued = NULL;
+    jb->queued = false;
+}
+
+/**
+ * Starts the queued background jobs that set -j has room for.
+ */
+static void jobs_start_queued(void)
+{
+    /* job_start() can get here again, through proc_update() */
+    static bool starting = false;
+
+    if (starting)
+        return;
+    starting = true;
+
+    while (queued_jobs != NULL && !bg_limit_reached()) {
+        struct job *jb = queued_jobs;
+
+        job_dequeue(jb);
+        job_start(jb);
+    }
+
+    starting = false;
+}
+
+/**
+ * Gives {@jb} the lowest free id, which makes it one of the jobs.
+ * It is reported at the next jobs_notifications().
+ */
+static void job_add(struct job *jb)
+{
+    size_t slot = job_slots_free;
+
+    while (slot < num_job_slots && job_slots[slot] != NULL)
+        ++slot;
+
+    if (slot == num_job_slots) {
+        size_t n = num_job_slots > 0 ? num_job_slots * 2 : 16;
+
+        job_slots = realloc(job_slots, n * sizeof(*job_slots));
+        memset(job_slots + num_job_slots, 0, (n - num_job_slots) * sizeof(*job_slots));
+        num_job_slots = n;
+    }
+
+    job_slots[slot] = jb;
+    job_slots_free = slot + 1;
+    jb->id = slot + 1;
+
+    job_mark_dirty(jb);
+
+    if (jb->is_bg)
+        job_make_current(jb);
+}
+
+/**
+ * Returns the job that {@spec} refers to: %n or n for the job with id n,
+ * %+ or %% for the current job, and %- for the previous one. Says so on
+ * behalf of {@cmdname} if there is no such job.
+ */
+static struct job *job_find(const char *spec, const char *cmdname)
+{
+    struct job *jb = NULL;
+    const char *num = spec;
+
+    if (spec[0] == '%') {
+        num = spec + 1;
+        if (strcmp(num, "+") == 0 || strcmp(num, "%") == 0 || *num == '\0')
+            jb = cur_job;
+        else if (strcmp(num, "-") == 0)
+            jb = prev_job;
+    }
+
+    if (jb == NULL && *num >= '0' && *num <= '9') {
+        char *end;
+        long id = strtol(num, &end, 10);
+
+        if (*end == '\0' && id > 0 && (size_t) id <= num_job_slots)
+            jb = job_slots[id - 1];
+    }
+
+    if (jb == NULL)
+        fprintf(stderr, "%s: invalid job_id %s\n", cmdname, spec);
+    return jb;
+}
+
+/**
+ * Returns what {@jb} is doing, for job_display().
+ */
+static const char *job_state(const struct job *jb)
+{
+    if (jb->queued)
+        return "queued ";
+    else if (job_stopped(jb))
+        return "stopped ";
+    else if (job_finished(jb))
+        return "done ";
+    else
+        return "running ";
+}
+
 static void job_display(const struct job *jb, 
         bool more_info, 
         bool display_only_pids,
-        long curjob,
         int outfile)
 {
     char buf[1024];
@@ -216,7 +730,7 @@ static void job_display(const struct job *jb,
         size_t padding;
         char padbuf[48];
 
-        snprintf(buf, sizeof(buf), "[%ld] ", curjob);
+        snprintf(buf, sizeof(buf), "[%d] ", jb->id);
         padding = strlen(buf);
         write(outfile, buf, padding);
         padding += 2;
@@ -226,10 +740,10 @@ static void job_display(const struct job *jb,
         for (struct proc *p = jb->procs; p != NULL; p = p->next) {
             if (p != jb->procs)
                 write(outfile, padbuf, padding);
-            if (p->pid == jb->pgid)
+            if (p->pid == jb->pgid && !jb->queued)
                 write(outfile, "+ ", 2);
-            /* write PID */
-            if (!display_only_pids || p->pid == jb->pgid) {
+            /* write PID, which a queued job does not have yet */
+            if ((!display_only_pids || p->pid == jb->pgid) && !jb->queued) {
                 snprintf(buf, sizeof(buf), "%6d ", p->pid);
                 write(outfile, buf, strlen(buf));
             } else {
@@ -237,28 +751,18 @@ static void job_display(const struct job *jb,
             }
 
             /* write state */
-            if (job_stopped(jb))
-                snprintf(buf, sizeof(buf), "stopped ");
-            else if (job_finished(jb))
-                snprintf(buf, sizeof(buf), "done ");
-            else
-                snprintf(buf, sizeof(buf), "running ");
-            write(outfile, buf, strlen(buf));
+            write(outfile, job_state(jb), strlen(job_state(jb)));
             /* display command */
             write(outfile, p->name, strlen(p->name));
             write(outfile, "\n", 1);
         }
     } else {
-        snprintf(buf, sizeof(buf), "[%ld] + ", curjob);
-        write(outfile, buf, strlen(buf));
-        if (job_stopped(jb))
-            snprintf(buf, sizeof(buf), "stopped ");
-        else if (job_finished(jb))
-            snprintf(buf, sizeof(buf), "done ");
-        else
-            snprintf(buf, sizeof(buf), "running ");
+        snprintf(buf, sizeof(buf), "[%d] %c ", jb->id,
+                jb == cur_job ? '+' : jb == prev_job ? '-' : ' ');
         write(outfile, buf, strlen(buf));
+        write(outfile, job_state(jb), strlen(job_state(jb)));
         /* display command */
+        write(outfile, " ", 1);
         write(outfile, jb->cmdline, strlen(jb->cmdline));
         write(outfile, "\n", 1);
     }
@@ -272,7 +776,7 @@ static int proc_internal_cmd_jobs(char **argv, int infile, int outfile)
      * the other */
     bool more_info = false;         /* -l option */
     bool display_only_pids = false; /* -p option */
-    long job_id = 0;
+    struct job *only = NULL;
 
     argp = argv + 1;
     while (*argp != NULL) {
@@ -280,35 +784,19 @@ static int proc_internal_cmd_jobs(char **argv, int infile, int outfile)
             more_info = true;
         else if (strcmp(*argp, "-p") == 0)
             display_only_pids = true;
-        else {
-            job_id = strtol(*argp, NULL, 0);
-            if (job_id <= 0 || errno == ERANGE) {
-                fprintf(stderr, "jobs: invalid job_id %s\n", *argp);
-                return -1;
-            }
-        }
+        else if ((only = job_find(*argp, "jobs")) == NULL)
+            return -1;
         ++argp;
     }
 
-    long curjob = 1;
-    struct job *jb = jobs;
-
-    while (jb != NULL) {
-        if (job_id > 0 && curjob != job_id) {
-            ++curjob;
-            jb = jb->next;
-            continue;
-        }
-
-        job_display(jb, more_info, display_only_pids, curjob, outfile);
-
-        ++curjob;
-        jb = jb->next;
+    if (only != NULL) {
+        job_display(only, more_info, display_only_pids, outfile);
+        return 0;
     }
 
-    if (job_id > curjob) {
-        fprintf(stderr, "jobs: invalid job_id %ld\n", job_id);
-        return -1;
+    for (size_t i = 0; i < num_job_slots; ++i) {
+        if (job_slots[i] != NULL)
+            job_display(job_slots[i], more_info, display_only_pids, outfile);
     }
 
     return 0;
@@ -316,86 +804,34 @@ static int proc_internal_cmd_jobs(char **argv, int infile, int outfile)
 
 static int proc_internal_cmd_fg(char **argv, int infile, int outfile)
 {
-    char **argp;
-    long job_id = 0;
+    struct job *jb = cur_job;
 
-    argp = argv + 1;
-    while (*argp != NULL) {
-        job_id = strtol(*argp, NULL, 0);
-        if (job_id <= 0 || errno == ERANGE) {
-            fprintf(stderr, "fg: invalid job_id %s\n", *argp);
-            return -1;
-        }
-        ++argp;
-    }
+    /* take a specific job, or the current one, and move it to the foreground */
+    if (argv[1] != NULL && (jb = job_find(argv[1], "fg")) == NULL)
+        return -1;
 
-    /* take a specific job and move it to the foreground */
-    if (job_id > 0) {
-        struct job *jb = jobs;
-        long curjob = 1;
-
-        while (jb != NULL) {
-            if (job_id == curjob) {
-                job_continue(jb, false);
-                return 0;
-            }
-            jb = jb->next;
-            ++curjob;
-        }
-
-        fprintf(stderr, "fg: invalid job_id %ld\n", job_id);
-        return -1;
-    }
-
-    /* take the most recent job and move it to the foreground */
-    if (jobs != NULL)
-        job_continue(jobs, false);
-    return 0;
-}
+    if (jb != NULL)
+        job_continue(jb, false);
+    return 0;
+}
 
 static int proc_internal_cmd_bg(char **argv, int infile, int outfile)
 {
-    char **argp;
-    long job_id = 0;
-
-    argp = argv + 1;
-    while (*argp != NULL) {
-        job_id = strtol(*argp, NULL, 0);
-        if (job_id <= 0 || errno == ERANGE) {
-            fprintf(stderr, "bg: invalid job_id %s\n", *argp);
-            return -1;
-        }
-        ++argp;
-    }
-
-    /* take a specific job and move it to the background */
-    if (job_id > 0) {
-        struct job *jb = jobs;
-        long curjob = 1;
-
-        while (jb != NULL) {
-            if (job_id == curjob) {
-                job_continue(jb, true);
-                return 0;
-            }
-            jb = jb->next;
-            ++curjob;
-        }
+    struct job *jb = cur_job;
 
-        fprintf(stderr, "bg: invalid job_id %ld\n", job_id);
+    /* take a specific job, or the current one, and move it to the background */
+    if (argv[1] != NULL && (jb = job_find(argv[1], "bg")) == NULL)
         return -1;
-    }
 
-    /* take the most recent job and move it to the background */
-    if (jobs != NULL)
-        job_continue(jobs, true);
+    if (jb != NULL)
+        job_continue(jb, true);
     return 0;
 }
 
 static int proc_internal_cmd_exit(char **argv, int infile, int outfile)
 {
     char **argp;
-    long exit_status = 0;
+    long exit_status = last_status;
 
     argp = argv + 1;
 
@@ -423,6 +859,152 @@ static int proc_internal_cmd_help(char **argv, int infile, int outfile)
     return 0;
 }
 
+static int proc_internal_cmd_hash(char **argv, int infile, int outfile)
+{
+    char **argp = argv + 1;
+    int status = 0;
+
+    if (*argp == NULL) {
+        cmdhash_list(outfile);
+        return 0;
+    }
+
+    for (; *argp != NULL; ++argp) {
+        if (strcmp(*argp, "-r") == 0) {
+            cmdhash_clear();
+        } else if (strcmp(*argp, "-d") == 0 && argp[1] != NULL) {
+            cmdhash_forget(*++argp);
+        } else if (strcmp(*argp, "-p") == 0 && argp[1] != NULL && argp[2] != NULL) {
+            cmdhash_set(argp[2], argp[1]);
+            argp += 2;
+        } else if (**argp == '-') {
+            fprintf(stderr, "hash: usage: hash [-r] [-d name] [-p path name] [name...]\n");
+            return -1;
+        } else if (!proc_internal_exists(*argp) && cmdhash_lookup(*argp) == NULL) {
+            fprintf(stderr, "hash: %s: not found\n", *argp);
+            status = -1;
+        }
+    }
+
+    return status;
+}
+
+static int proc_internal_cmd_set(char **argv, int infile, int outfile)
+{
+    char **argp = argv + 1;
+
+    if (*argp == NULL || (strcmp(*argp, "-o") == 0 && argp[1] == NULL)) {
+        for (struct shell_option *o = &options[0]; o->name != NULL; ++o)
+            dprintf(outfile, "%-16s%s\n", o->name, *o->value ? "on" : "off");
+        dprintf(outfile, "%-16s%ld\n", "-j", bg_limit());
+        return 0;
+    }
+
+    for (; *argp != NULL; argp += 2) {
+        struct shell_option *o = &options[0];
+
+        /* background jobs at once, 0 for no limit */
+        if (strcmp(*argp, "-j") == 0 && argp[1] != NULL) {
+            char *end;
+            long n = strtol(argp[1], &end, 10);
+
+            if (*argp[1] == '\0' || *end != '\0' || n < 0) {
+                fprintf(stderr, "set: -j: invalid number %s\n", argp[1]);
+                return -1;
+            }
+            max_bg_jobs = n;
+            jobs_start_queued();
+            continue;
+        }
+
+        if ((strcmp(*argp, "-o") != 0 && strcmp(*argp, "+o") != 0) || argp[1] == NULL) {
+            fprintf(stderr, "set: usage: set [-o|+o option] [-j jobs]\n");
+            return -1;
+        }
+
+        while (o->name != NULL && strcmp(o->name, argp[1]) != 0)
+            ++o;
+        if (o->name == NULL) {
+            fprintf(stderr, "set: %s: no such option\n", argp[1]);
+            return -1;
+        }
+        *o->value = **argp == '-';
+    }
+
+    return 0;
+}
+
+static int proc_internal_cmd_prefetch(char **argv, int infile, int outfile)
+{
+    if (argv[1] == NULL) {
+        prefetch_report(outfile);
+    } else if (strcmp(argv[1], "-r") == 0 && argv[2] == NULL) {
+        prefetch_reset();
+    } else {
+        fprintf(stderr, "prefetch: usage: prefetch [-r]\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Parses the options of the batch builtin in {@argv} into {@max_args},
+ * {@max_chars} and {@max_procs}. Returns where the command starts, or
+ * NULL after saying what is wrong.
+ */
+static char **batch_options(char **argv, size_t *max_args, size_t *max_chars, size_t *max_procs)
+{
+    char **argp = argv + 1;
+
+    for (; *argp != NULL && **argp == '-'; ++argp) {
+        size_t *value;
+        char *end;
+
+        if (strcmp(*argp, "--") == 0) {
+            ++argp;
+            break;
+        }
+
+        if (strcmp(*argp, "-n") == 0)
+            value = max_args;
+        else if (strcmp(*argp, "-s") == 0)
+            value = max_chars;
+        else if (strcmp(*argp, "-P") == 0)
+            value = max_procs;
+        else
+            break;
+
+        if (argp[1] == NULL)
+            break;
+
+        errno = 0;
+        *value = strtoul(*++argp, &end, 10);
+        if (**argp < '0' || **argp > '9' || *end != '\0' || errno == ERANGE) {
+            fprintf(stderr, "batch: %s: invalid number\n", *argp);
+            return NULL;
+        }
+    }
+
+    if (*argp == NULL || **argp == '-') {
+        fprintf(stderr, "batch: usage: batch [-n args] [-s size] [-P procs] command [fixed args... --] [args...]\n");
+        return NULL;
+    }
+
+    if (*max_procs == 0)
+        *max_procs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return argp;
+}
+
+/**
+ * Returns true if {@argv} is run in chunks, see job_batch_start().
+ */
+static bool argv_is_batch(char **argv)
+{
+    return strcmp(argv[0], "batch") == 0 || (opt_autobatch && !batch_fits(argv));
+}
+
 static intproc proc_internal_get(const char *cmdname)
 {
     for (struct builtin *b = &builtins[0]; b->name != NULL; ++b) {
@@ -432,10 +1014,62 @@ static intproc proc_internal_get(const char *cmdname)
     return NULL;
 }
 
+/**
+ * Returns true if {@cmdname} is a builtin, including batch, which has
+ * no function of its own.
+ */
+static bool proc_internal_exists(const char *cmdname)
+{
+    for (struct builtin *b = &builtins[0]; b->name != NULL; ++b) {
+        if (strcmp(cmdname, b->name) == 0)
+            return true;
+    }
+    return false;
+}
+
 /* end of internal processes */
 
-static void proc_exec(struct proc *proc, int pgid, int fdin, int fdout, int fderr, bool is_bg)
+/**
+ * Returns one past the highest descriptor that is not close-on-exec, or
+ * -1 if that cannot be told. Everything the shell opens is, so these are
+ * the ones it was started with, which its children get as well. Anything
+ * above them is closed in the children, in case it leaked.
+ */
+static int inherited_fds_end(void)
 {
+    static int end = 0;
+    struct dirent *ent;
+    DIR *dir;
+
+    if (end != 0)
+        return end;
+
+    if ((dir = opendir("/proc/self/fd")) == NULL)
+        return end = -1;
+
+    end = STDERR_FILENO + 1;
+    while ((ent = readdir(dir)) != NULL) {
+        int fd = atoi(ent->d_name);
+        int flags;
+
+        if (fd >= end && fd != dirfd(dir)
+                && (flags = fcntl(fd, F_GETFD)) != -1 && !(flags & FD_CLOEXEC))
+            end = fd + 1;
+    }
+    closedir(dir);
+
+    return end;
+}
+
+static void proc_exec(struct proc *proc, const char *path, int pgid,
+        int fdin, int fdout, int fderr, bool is_bg)
+{
+    sigset_t sigmask;
+
+    /* the shell may have SIGCHLD blocked, see main.c */
+    sigemptyset(&sigmask);
+    sigprocmask(SIG_SETMASK, &sigmask, NULL);
+
     /* we only care about job control if we're on a tty */
     if (interactive) {
         pid_t pid;
@@ -481,102 +1115,325 @@ static void proc_exec(struct proc *proc, int pgid, int fdin, int fdout, int fder
         close(fderr);
     }
 
+    if (inherited_fds_end() != -1)
+        spawn_close_from(inherited_fds_end(), false);
+
 #ifdef DEBUG_PROC
     for (size_t i=0; proc->argv[i] != NULL; ++i)
         fprintf(stderr, "%s ", proc->argv[i]);
     fprintf(stderr, "\n");
 #endif
 
-    execvp(proc->name, proc->argv);
+    execv(path, proc->argv);
+    /* the program moved since it was found, so look for it again */
+    if (errno == ENOENT && path != proc->name)
+        execvp(proc->name, proc->argv);
     perror(proc->name);
-    /* child exits if exec failed */
-    exit(EXIT_FAILURE);
+    /* child exits if exec failed, without flushing the stdio buffers
+     * it shares with the shell: flushing stdin moves the input offset */
+    _exit(EXIT_FAILURE);
 }
 
-int job_exec(struct an_pipeline *pln)
+/**
+ * Spawns {@p} from {@path} as a process of {@jb}. See spawn_proc().
+ */
+static int proc_spawn(struct job *jb, struct proc *p, const char *path, int fdin, int fdout)
 {
-    struct job *jb;
-    char cwd[1024];
-    int dirfd = -1;
-    int fin_fd = -1;
-    int fout_fd = -1;
+    int tty_fd = interactive && !jb->is_bg ? shell_input_fd : -1;
+    int error = SPAWN_UNSUPPORTED;
 
-    if (getcwd(cwd, sizeof(cwd)) == NULL) {
-        perror("getcwd()");
-        return -1;
-    }
+    int close_from = inherited_fds_end();
 
-    if ((dirfd = open(cwd, O_RDONLY | O_DIRECTORY)) == -1) {
-        perror("open()");
-        return -1;
+    if (zygote_running())
+        error = zygote_spawn(p, path, jb->pgid, fdin, fdout, jb->stderr_fd,
+                interactive, tty_fd, close_from);
+    if (error == SPAWN_UNSUPPORTED)
+        error = spawn_proc(p, path, jb->pgid, fdin, fdout, jb->stderr_fd,
+                interactive, tty_fd, close_from);
+
+    return error;
+}
+
+/**
+ * Starts the program {@p} of {@jb}, reading {@fdin} and writing {@fdout},
+ * in the job's process group. If the program cannot be run, says why and
+ * marks it finished, as if it had failed in the child. Returns -1 if there
+ * could not even be a child, e.g. at the process limit.
+ */
+static int proc_start(struct job *jb, struct proc *p, int fdin, int fdout)
+{
+    const char *path = cmdhash_lookup(p->name);
+    int error = path != NULL ? proc_spawn(jb, p, path, fdin, fdout) : errno;
+
+    /* the program moved since it was found, so look for it again */
+    if (error == ENOENT && path != NULL && path != p->name) {
+        cmdhash_forget(p->name);
+        path = cmdhash_lookup(p->name);
+        error = path != NULL ? proc_spawn(jb, p, path, fdin, fdout) : errno;
     }
 
-    jb = calloc(1, sizeof(*jb));
+    if (error == SPAWN_UNSUPPORTED) {
+        pid_t child_pid = fork();
 
-    /* set standard input */
-    if (pln->file_in != NULL) {
-        if (pln->file_in->is_rel) {
-            if ((fin_fd = openat(dirfd, pln->file_in->fname, O_RDONLY)) == -1) {
-                perror(pln->file_in->fname);
-                free(jb);
-                close(dirfd);
-                return -1;
-            }
-        } else {
-            if ((fin_fd = open(pln->file_in->fname, O_RDONLY)) == -1) {
-                perror(pln->file_in->fname);
-                free(jb);
-                close(dirfd);
-                return -1;
-            }
+        if (child_pid < 0) {
+            perror("fork()");
+            return -1;
+        } else if (child_pid == 0) {
+            /* child */
+            proc_exec(p, path, jb->pgid, fdin, fdout, jb->stderr_fd, jb->is_bg);
         }
+        p->pid = child_pid;
+    } else if (error != 0) {
+        /* what the child would have said if exec failed */
+        fprintf(stderr, "%s: %s\n", p->name, strerror(error));
+        p->status = W_EXITCODE(EXIT_FAILURE, 0);
+        proc_set_finished(p);
+
+        /* the child took the terminal for a group of its own before it failed */
+        if (path != NULL && interactive && !jb->is_bg && jb->pgid == 0)
+            tcsetpgrp(shell_input_fd, shell_pgid);
+    }
 
-        jb->stdin_fd = fin_fd;
-    } else {
-        jb->stdin_fd = shell_input_fd;
-        fin_fd = jb->stdin_fd;
+    if (p->pid != 0) {
+        proc_index(p);
+#ifdef HAVE_PIDFD
+        /* see job_wait_change() */
+        p->pidfd = pidfd_open(p->pid, 0);
+#endif
     }
 
-    /* set standard output */
-    if (pln->file_out != NULL) {
-
-        if (pln->file_out->is_rel) {
-            if ((fout_fd = openat(dirfd, pln->file_out->fname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
-                perror(pln->file_out->fname);
-                if (fin_fd != -1 && fin_fd != STDIN_FILENO)
-                    close(fin_fd);
-                free(jb);
-                close(dirfd);
-                return -1;
+    /* we only care about job control if we're
+     * on a tty */
+    if (p->pid != 0 && interactive) {
+        if (jb->pgid == 0)
+            jb->pgid = p->pid;
+        /* set child to belong to the job group */
+        setpgid(p->pid, jb->pgid);
+    }
+
+    return 0;
+}
+
+/**
+ * A stage of a job that runs a command in chunks, see job_batch_start().
+ */
+struct job_batch {
+    struct batch b;
+    /* the stage, and where the next chunk goes: before the stage */
+    struct proc *stage;
+    struct proc **lastp;
+    /* the stage's input and output, kept for the chunks to come */
+    int fdin, fdout;
+    size_t max_procs;
+    size_t running;
+    bool more;
+    bool failed;
+};
+
+/**
+ * Marks the stage of {@jbt} finished, failed if any chunk did.
+ */
+static void job_batch_finish(struct job_batch *jbt)
+{
+    close(jbt->fdin);
+    close(jbt->fdout);
+    jbt->fdin = jbt->fdout = -1;
+
+    jbt->stage->status = W_EXITCODE(jbt->failed ? EXIT_FAILURE : 0, 0);
+    proc_set_finished(jbt->stage);
+}
+
+/**
+ * Starts chunks of {@jbt}, a stage of {@jb}, until as many run as it
+ * may have at once, or there are no more.
+ */
+static void job_batch_fill(struct job *jb, struct job_batch *jbt)
+{
+    while (jbt->more && jbt->running < jbt->max_procs) {
+        struct proc *p;
+        char **chunk;
+
+        errno = 0;
+        if ((chunk = batch_next(&jbt->b)) == NULL) {
+            if (errno == E2BIG) {
+                fprintf(stderr, "%.32s...: %s\n", jbt->b.argv[jbt->b.next], strerror(E2BIG));
+                jbt->failed = true;
             }
+            jbt->more = false;
+            break;
+        }
+
+        p = calloc(1, sizeof(*p));
+        p->argv = chunk;
+        p->name = chunk[0];
+        p->pidfd = -1;
+        p->job = jb;
+        p->batch = jbt;
+        jb->num_procs++;
+        p->next = jbt->stage;
+        *jbt->lastp = p;
+        jbt->lastp = &p->next;
+
+        /* once all the others are reaped, their group is gone */
+        if (jb->pgid != 0 && kill(-jb->pgid, 0) == -1)
+            jb->pgid = 0;
+
+        if (proc_start(jb, p, jbt->fdin, jbt->fdout) == 0 && p->pid != 0) {
+            jbt->running++;
         } else {
-            if ((fout_fd = open(pln->file_out->fname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
-                perror(pln->file_out->fname);
-                if (fin_fd != -1 && fin_fd != STDIN_FILENO)
-                    close(fin_fd);
-                free(jb);
-                close(dirfd);
-                return -1;
+            /* the others would fail the same way */
+            jbt->failed = true;
+            jbt->more = false;
+            if (!p->finished) {
+                p->status = W_EXITCODE(EXIT_FAILURE, 0);
+                proc_set_finished(p);
             }
         }
+    }
 
-        jb->stdout_fd = fout_fd;
-    } else {
-        jb->stdout_fd = STDOUT_FILENO;
-        fout_fd = jb->stdout_fd;
+    if (!jbt->more && jbt->running == 0 && !jbt->stage->finished)
+        job_batch_finish(jbt);
+}
+
+/**
+ * Starts the stage {@p} of {@jb}, which {@pp} points to, reading {@fdin}
+ * and writing {@fdout}. It runs a command in chunks that each fit in one
+ * exec() (see batch.h): the batch builtin's, or with autobatch, one that
+ * is too long. The chunks become processes of the job, ahead of the
+ * stage in its list, with at most max_procs of them running at a time;
+ * proc_update() starts the next ones as they finish. The stage finishes
+ * after the last chunk, failed if any chunk did.
+ */
+static void job_batch_start(struct job *jb, struct proc *p, struct proc **pp, int fdin, int fdout)
+{
+    struct job_batch *jbt;
+    char **argv = p->argv;
+    size_t max_args = 0;
+    size_t max_chars = 0;
+    size_t max_procs = 1;
+
+    if (strcmp(p->name, "batch") == 0
+            && (argv = batch_options(p->argv, &max_args, &max_chars, &max_procs)) == NULL) {
+        p->status = W_EXITCODE(EXIT_FAILURE, 0);
+        proc_set_finished(p);
+        return;
     }
 
-    jb->stderr_fd = STDERR_FILENO;
+    jbt = calloc(1, sizeof(*jbt));
+    if (batch_init(&jbt->b, argv, max_args, max_chars) == -1) {
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(E2BIG));
+        free(jbt);
+        p->status = W_EXITCODE(EXIT_FAILURE, 0);
+        proc_set_finished(p);
+        return;
+    }
 
-    jb->is_bg = pln->is_bg;
+    jbt->stage = p;
+    jbt->lastp = pp;
+    /* the caller closes its own once the stage has started */
+    jbt->fdin = fcntl(fdin, F_DUPFD_CLOEXEC, 0);
+    jbt->fdout = fcntl(fdout, F_DUPFD_CLOEXEC, 0);
+    jbt->max_procs = max_procs;
+    jbt->more = true;
+    p->batch = jbt;
+
+    job_batch_fill(jb, jbt);
+}
+
+/**
+ * Takes note that the chunk {@p} stopped, continued or finished, and
+ * starts the next ones if it finished.
+ */
+static void job_batch_update(struct proc *p)
+{
+    struct job_batch *jbt = p->batch;
+
+    /* like xargs, stop when a chunk is stopped or killed, e.g. by ^Z or ^C */
+    if ((p->stopped || (p->finished && WIFSIGNALED(p->status))) && jbt->more) {
+        fprintf(stderr, "batch: %zu arguments were not run\n", jbt->b.argc - jbt->b.next);
+        jbt->more = false;
+    }
+
+    /* the stage waits for its chunks, so it stops along with them */
+    proc_set_stopped(jbt->stage, p->stopped);
+    if (!p->finished)
+        return;
+
+    jbt->running--;
+    if (p->status != 0)
+        jbt->failed = true;
+    job_batch_fill(p->job, jbt);
+}
+
+/**
+ * Makes the status of the last process of {@jb} the shell's.
+ */
+static void job_set_status(const struct job *jb)
+{
+    const struct proc *p = jb->procs;
+
+    if (p == NULL)
+        return;
+    while (p->next != NULL)
+        p = p->next;
 
-    /* cleanup */
-    close(dirfd);
+    if (WIFSIGNALED(p->status))
+        last_status = 128 + WTERMSIG(p->status);
+    else if (WIFSTOPPED(p->status))
+        last_status = 128 + WSTOPSIG(p->status);
+    else
+        last_status = WEXITSTATUS(p->status);
+}
+
+/**
+ * Copies the {@argc} arguments {@args} and the strings they point to
+ * into one allocation, which is freed all at once.
+ */
+static char **argv_copy(char *const *args, size_t argc)
+{
+    size_t size = (argc + 1) * sizeof(char *);
+    char **argv;
+    char *str;
+
+    for (size_t i = 0; i < argc; ++i)
+        size += strlen(args[i]) + 1;
+
+    argv = malloc(size);
+    str = (char *) (argv + argc + 1);
+    for (size_t i = 0; i < argc; ++i) {
+        size_t len = strlen(args[i]) + 1;
+
+        argv[i] = memcpy(str, args[i], len);
+        str += len;
+    }
+    argv[argc] = NULL;
+
+    return argv;
+}
 
+/**
+ * Sets up the job for {@pln} without starting it: the arguments of its
+ * processes and the files it redirects are copied out of the pipeline.
+ */
+static struct job *job_new(struct an_pipeline *pln)
+{
+    struct job *jb = calloc(1, sizeof(*jb));
     struct proc **lastp = &jb->procs;
 
-    size_t cmdline_size = 1;
-    jb->cmdline = calloc(1, 1);
+    jb->stdin_fd = shell_input_fd;
+    jb->stdout_fd = STDOUT_FILENO;
+    jb->stderr_fd = STDERR_FILENO;
+
+    jb->is_bg = pln->is_bg;
+
+    /* shown as it was typed, if the job is ever shown */
+    jb->cmdline = strndup(pln->source.data, pln->source.len);
+
+    /* opened when the job starts */
+    if (pln->file_in != NULL)
+        jb->file_in = strdup(pln->file_in->fname);
+    if (pln->file_out != NULL)
+        jb->file_out = strdup(pln->file_out->fname);
 
     /* now, create the processes */
     for (struct link *lnk = pln->procs->head;
@@ -587,65 +1444,89 @@ int job_exec(struct an_pipeline *pln)
 
         anproc = lnk->data;
 
-        if (lnk != pln->procs->head) {
-            jb->cmdline = realloc(jb->cmdline, cmdline_size + 2);
-            strcat(jb->cmdline, " |");
-            cmdline_size += 2;
-        }
-
         proc = calloc(1, sizeof(*proc));
-        proc->argv = calloc(anproc->num_args, sizeof(proc->argv[0]));
-        for (size_t i=0; i<anproc->num_args; ++i) {
-            proc->argv[i] = anproc->args[i] != NULL ? strdup(anproc->args[i]) : NULL;
-            if (proc->argv[i] != NULL) {
-                size_t arglen = 1 + strlen(proc->argv[i]);
-
-                jb->cmdline = realloc(jb->cmdline, cmdline_size + arglen);
-                strcat(jb->cmdline, " ");
-                strcat(jb->cmdline, proc->argv[i]);
-                cmdline_size += arglen;
-            }
-        }
+        proc->argv = argv_copy(anproc->args, anproc->num_args - 1);
         proc->name = proc->argv[0];
+        proc->pidfd = -1;
+        proc->job = jb;
+        jb->num_procs++;
 
         *lastp = proc;
         lastp = &(*lastp)->next;
     }
 
-    /* add redirection operators to cmdline */
-
-    if (pln->file_in != NULL) {
-        size_t len = 3 + strlen(pln->file_in->fname);
+    return jb;
+}
 
-        jb->cmdline = realloc(jb->cmdline, cmdline_size + len);
-        strcat(jb->cmdline, " < ");
-        strcat(jb->cmdline, pln->file_in->fname);
-        cmdline_size += len;
+int job_exec(struct an_pipeline *pln)
+{
+    struct job *jb = job_new(pln);
+
+    /* past the limit of set -j, it waits for a running one to finish */
+    if (jb->is_bg && bg_limit_reached()) {
+        jb->queued = true;
+        *queued_tail = jb;
+        queued_tail = &jb->next_queued;
+        job_add(jb);
+        return 0;
     }
 
-    if (pln->file_out != NULL) {
-        size_t len = 3 + strlen(pln->file_out->fname);
+    return job_start(jb);
+}
 
-        jb->cmdline = realloc(jb->cmdline, cmdline_size + len);
-        strcat(jb->cmdline, " > ");
-        strcat(jb->cmdline, pln->file_out->fname);
-        cmdline_size += len;
+/**
+ * Opens the files {@jb} redirects, starts its processes, and waits for
+ * them unless it runs in the background. Afterwards, the job is one of
+ * the jobs, unless it finished in the foreground. Returns -1 if it
+ * could not be started, in which case it is destroyed.
+ */
+static int job_start(struct job *jb)
+{
+    int fin_fd = -1;
+    int fout_fd = -1;
+
+    /* set standard input */
+    if (jb->file_in != NULL) {
+        if ((fin_fd = openat(cwd_dirfd(), jb->file_in, O_RDONLY | O_CLOEXEC)) == -1) {
+            perror(jb->file_in);
+            job_destroy(jb);
+            last_status = EXIT_FAILURE;
+            return -1;
+        }
+
+        jb->stdin_fd = fin_fd;
+    } else {
+        fin_fd = jb->stdin_fd;
     }
 
+    /* set standard output */
+    if (jb->file_out != NULL) {
+        if ((fout_fd = openat(cwd_dirfd(), jb->file_out,
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) == -1) {
+            perror(jb->file_out);
+            job_destroy(jb);
+            last_status = EXIT_FAILURE;
+            return -1;
+        }
+
+        jb->stdout_fd = fout_fd;
+    } else {
+        fout_fd = jb->stdout_fd;
+    }
 
     /* now create the actual processes */
-    for (struct proc *p = jb->procs; p != NULL; p = p->next) {
-        pid_t child_pid;
-        int pipefds[2];
+    struct proc **pp = &jb->procs;
+
+    for (struct proc *p; (p = *pp) != NULL; pp = &p->next) {
+        int pipefds[2] = { -1, -1 };
 
-        /* we want to set up pipes first */
+        /* we want to set up pipes first; only the pipe to the next stage
+         * and the one from the last are open at a time */
         if (p->next != NULL) {
-            if (pipe(pipefds) < 0) {
-                perror("pipe()");
-                /**
-                 * If opening a pipe fails, then I guess we're in big trouble.
-                 */
-                exit(EXIT_FAILURE);
+            if (pipe2(pipefds, O_CLOEXEC) < 0) {
+                perror("pipe2()");
+                fout_fd = jb->stdout_fd;
+                goto rollback;
             }
             fout_fd = pipefds[1];
         } else
@@ -653,38 +1534,18 @@ int job_exec(struct an_pipeline *pln)
 
         intproc internal_proc = proc_internal_get(p->name);
 
-        if (internal_proc != NULL) {
-            (*internal_proc)(p->argv, fin_fd, fout_fd);
-            p->finished = true;
-        } else {
-            /* now fork */
-            child_pid = fork();
-            if (child_pid < 0) {
-                /* fork failed */
-                perror("fork()");
-                /**
-                 * fork() *COULD* fail, but:
-                 * - limit for NPROC is 63k
-                 * - if memory is exhausted then there are more problems ahead
-                 * Maybe it's not worth it to try to recover gracefully.
-                 */
-                exit(EXIT_FAILURE);
-            } else if (child_pid == 0) {
-                /* child */
-                proc_exec(p, jb->pgid, fin_fd, fout_fd, jb->stderr_fd, jb->is_bg);
-            } else {
-                /* parent */
-                p->pid = child_pid;
-
-                /* we only care about job control if we're
-                 * on a tty */
-                if (interactive) {
-                    if (jb->pgid == 0)
-                        jb->pgid = child_pid;
-                    /* set child to belong to the job group */
-                    setpgid(child_pid, jb->pgid);
-                }
-            }
+        if (argv_is_batch(p->argv)) {
+            /* with autobatch, it would fail with E2BIG otherwise */
+            job_batch_start(jb, p, pp, fin_fd, fout_fd);
+        } else if (internal_proc != NULL) {
+            int ret = (*internal_proc)(p->argv, fin_fd, fout_fd);
+
+            p->status = W_EXITCODE(ret == 0 ? 0 : EXIT_FAILURE, 0);
+            proc_set_finished(p);
+        } else if (proc_start(jb, p, fin_fd, fout_fd) == -1) {
+            if (pipefds[0] != -1)
+                close(pipefds[0]);
+            goto rollback;
         }
 
         /* close any streams we opened in this process that were
@@ -698,72 +1559,179 @@ int job_exec(struct an_pipeline *pln)
         fin_fd = pipefds[0];
     }
 
-    /* add to the list of jobs */
-    jb->next = jobs;
-    jobs = jb;
+    /* add to the list of jobs, unless it was queued there */
+    if (jb->id == 0)
+        job_add(jb);
+    else
+        job_mark_dirty(jb);
+
+    if (jb->is_bg)
+        job_count(jb);
 
     /**
      * Don't wait for an internal job.
      */
-    if (job_is_internal(jb))
-        return 0;
-
-    /* now we should wait for our job */
-    if (!interactive)
+    if (job_is_internal(jb)) {
+        job_set_status(jb);
+    } else if (!interactive) {
+        /* now we should wait for our job */
         job_wait(jb);
-    else if (jb->is_bg)
+    } else if (jb->is_bg) {
         job_background(jb, false);
-    else
+    } else {
         job_foreground(jb, false);
+    }
+
+    if (job_finished(jb))
+        job_uncount(jb);
+
+    /* a foreground job that finished has nothing to report, and
+     * should not hold on to its id */
+    if (!jb->is_bg && job_finished(jb))
+        job_destroy(jb);
 
     return 0;
+
+rollback:
+    if (fin_fd != jb->stdin_fd)
+        close(fin_fd);
+    if (fout_fd != jb->stdout_fd)
+        close(fout_fd);
+
+    /* the stages that did start would wait on the ones that did not */
+    for (struct proc *p = jb->procs; p != NULL; p = p->next) {
+        if (p->pid != 0)
+            proc_kill(p, SIGKILL);
+    }
+    for (struct proc *p = jb->procs; p != NULL; p = p->next) {
+        if (p->pid != 0)
+            waitpid(p->pid, NULL, 0);
+    }
+
+    if (interactive && !jb->is_bg && jb->pgid != 0)
+        tcsetpgrp(shell_input_fd, shell_pgid);
+
+    job_destroy(jb);
+    last_status = EXIT_FAILURE;
+    return -1;
+}
+
+int job_exec_last(struct an_pipeline *pln)
+{
+    struct an_process *anproc = pln->procs->head != NULL ? pln->procs->head->data : NULL;
+    const char *path = NULL;
+    int fin_fd = STDIN_FILENO;
+    int fout_fd = STDOUT_FILENO;
+
+    /* the shell has to stay for anything else */
+    if (interactive || pln->is_bg || anproc == NULL || pln->procs->head->next != NULL
+            || proc_internal_exists(anproc->args[0]) || argv_is_batch(anproc->args)
+            || (path = cmdhash_lookup(anproc->args[0])) == NULL)
+        return job_exec(pln);
+
+    if (pln->file_in != NULL
+            && (fin_fd = openat(cwd_dirfd(), pln->file_in->fname, O_RDONLY)) == -1) {
+        perror(pln->file_in->fname);
+        last_status = EXIT_FAILURE;
+        return -1;
+    }
+
+    if (pln->file_out != NULL
+            && (fout_fd = openat(cwd_dirfd(), pln->file_out->fname,
+                    O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+        perror(pln->file_out->fname);
+        if (fin_fd != STDIN_FILENO)
+            close(fin_fd);
+        last_status = EXIT_FAILURE;
+        return -1;
+    }
+
+    /* not stdin: see proc_exec() */
+    fflush(stdout);
+    fflush(stderr);
+
+    if (fin_fd != STDIN_FILENO) {
+        dup2(fin_fd, STDIN_FILENO);
+        close(fin_fd);
+    }
+
+    if (fout_fd != STDOUT_FILENO) {
+        dup2(fout_fd, STDOUT_FILENO);
+        close(fout_fd);
+    }
+
+    /* the program would inherit the helper as a child */
+    zygote_stop();
+
+    execv(path, anproc->args);
+    /* the program moved since it was found, so look for it again */
+    if (errno == ENOENT && path != anproc->args[0])
+        execvp(anproc->args[0], anproc->args);
+    perror(anproc->args[0]);
+    exit(EXIT_FAILURE);
+}
+
+bool job_reads_input(const struct an_pipeline *pln)
+{
+    struct an_process *anproc = pln->procs->head != NULL ? pln->procs->head->data : NULL;
+    intproc func;
+
+    if (pln->file_in != NULL || anproc == NULL)
+        return false;
+
+    /* batch has no function, it runs programs */
+    func = proc_internal_get(anproc->args[0]);
+    return func == NULL || func == proc_internal_cmd_fg || func == proc_internal_cmd_bg;
 }
 
 bool job_stopped(const struct job *jb)
 {
-    for (struct proc *p = jb->procs; p != NULL; p = p->next)
-        if (!p->stopped)
-            return false;
-    return true;
+    return jb->num_stopped > 0 && jb->num_stopped + jb->num_finished == jb->num_procs;
 }
 
 bool job_finished(const struct job *jb)
 {
-    for (struct proc *p = jb->procs; p != NULL; p = p->next)
-        if (!p->finished)
-            return false;
-    return true;
+    return jb->num_finished == jb->num_procs;
 }
 
 static int proc_update(pid_t pid, int status) 
 {
-    struct proc *p = NULL;
-    struct job *jb = NULL;
-    int job_id = 1;
-
     if (pid > 0) {
-        for (jb = jobs; jb != NULL; jb = jb->next) {
-            for (p = jb->procs; p != NULL; p = p->next) {
-                if (p->pid == pid) {
-                    p->status = status;
-                    if (WIFSTOPPED(status)) {
-                        p->stopped = true;
-                    } else if (WIFCONTINUED(status)) {
-                        p->stopped = false;
-                    } else {
-                        p->finished = true;
-                        if (WIFSIGNALED(status))
-                            fprintf(stderr, "[%d] %d Terminated by signal %d.\n", job_id, (int) pid, WTERMSIG(status));
-                    }
-                    jb->notified = false;
-                    return 0;
-                }
-            }
-            ++job_id;
+        struct proc *p = procs_by_pid != NULL ? htable_get(procs_by_pid, PID_KEY(pid)) : NULL;
+
+        if (p == NULL) {
+            /* we did not find the process */
+            fprintf(stderr, "%d not found.\n", (int) pid);
+            return -1;
         }
-        /* we did not find the process */
-        fprintf(stderr, "[%d] %d not found.\n", job_id, (int) pid);
-        return -1;
+
+        p->status = status;
+        if (WIFSTOPPED(status)) {
+            proc_set_stopped(p, true);
+            if (job_stopped(p->job))
+                job_make_current(p->job);
+        } else if (WIFCONTINUED(status)) {
+            proc_set_stopped(p, false);
+        } else {
+            proc_set_finished(p);
+            if (WIFSIGNALED(status))
+                fprintf(stderr, "[%d] %d Terminated by signal %d.\n", p->job->id, (int) pid, WTERMSIG(status));
+        }
+        if (p->batch != NULL)
+            job_batch_update(p);
+
+        /* that makes room for a queued job */
+        if (p->job->counted && job_finished(p->job)) {
+            job_uncount(p->job);
+            jobs_start_queued();
+        }
+
+        /* the chunks of a batch come and go, which is not news */
+        if (p->batch == NULL || !p->finished)
+            p->job->notified = false;
+        if (p->job->id > 0)
+            job_mark_dirty(p->job);
+        return 0;
     } else if (pid == 0 || errno == ECHILD) {
         return -1;
     } else {
@@ -781,25 +1749,192 @@ bool job_is_internal(const struct job *jb)
     return true;
 }
 
-void job_wait(struct job *jb)
+#ifdef HAVE_PIDFD
+/**
+ * Returns the wait status that {@info}, from waitid(), stands for.
+ */
+static int siginfo_status(const siginfo_t *info)
+{
+    switch (info->si_code) {
+        case CLD_EXITED:
+            return W_EXITCODE(info->si_status, 0);
+        case CLD_KILLED:
+            return info->si_status;
+        case CLD_DUMPED:
+            return info->si_status | WCOREFLAG;
+        case CLD_STOPPED:
+        case CLD_TRAPPED:
+            return W_STOPCODE(info->si_status);
+        default:
+            return __W_CONTINUED;
+    }
+}
+
+/**
+ * Adds the pidfds of the running processes of {@jb} to {@fds}, of which
+ * there are {@n}, growing it as needed.
+ */
+static void job_add_pidfds(const struct job *jb, struct pollfd **fds, size_t *max_fds, nfds_t *n)
+{
+    /* a batch adds processes as it goes */
+    if (*max_fds < *n + jb->num_procs) {
+        *max_fds = *n + jb->num_procs;
+        *fds = realloc(*fds, *max_fds * sizeof(**fds));
+    }
+
+    for (struct proc *p = jb->procs; p != NULL; p = p->next) {
+        if (p->pid != 0 && !p->finished && p->pidfd != -1) {
+            (*fds)[*n].fd = p->pidfd;
+            (*fds)[(*n)++].events = POLLIN;
+        }
+    }
+}
+
+/**
+ * Updates the processes of {@jb} that have changed state, without
+ * waiting. Returns 0 if one has, 1 if one has no pidfd after all, and -1
+ * otherwise.
+ */
+static int job_waitid(struct job *jb)
+{
+    int ret = -1;
+
+    for (struct proc *p = jb->procs; p != NULL && ret != 1; p = p->next) {
+        siginfo_t info;
+
+        if (p->pid == 0 || p->finished)
+            continue;
+
+        info.si_pid = 0;
+        if (p->pidfd == -1 || waitid(P_PIDFD, p->pidfd, &info,
+                    WEXITED | WSTOPPED | WCONTINUED | WNOHANG) == -1)
+            ret = 1;    /* e.g. a kernel older than 5.4 */
+        else if (info.si_pid != 0 && proc_update(info.si_pid, siginfo_status(&info)) == 0)
+            ret = 0;
+    }
+    return ret;
+}
+
+/**
+ * Waits for the processes of {@jb} through their pidfds, see
+ * job_wait_change(). Returns 1 if one of them has none after all.
+ */
+static int job_wait_pidfds(struct job *jb)
+{
+    struct pollfd *fds = NULL;
+    size_t max_fds = 0;
+    sigset_t chld;
+    sigset_t mask;
+    int ret = -1;
+
+    /* exits show up on the pidfds, but stops only as a SIGCHLD */
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &mask);
+
+    for (;;) {
+        struct signalfd_siginfo si;
+        nfds_t n = 0;
+
+        if (max_fds == 0) {
+            max_fds = 1;
+            fds = malloc(sizeof(*fds));
+        }
+        fds[n].fd = chld_fd;
+        fds[n++].events = POLLIN;
+        job_add_pidfds(jb, &fds, &max_fds, &n);
+        if (n == 1)
+            break;
+
+        /* looked at before waiting, since a SIGCHLD from before is gone */
+        if ((ret = job_waitid(jb)) != -1)
+            break;
+
+        /*
+         * the running background jobs too while some are queued, or the
+         * queue would wait for this one; the rest are left to jobs_reap()
+         */
+        for (size_t i = 0; queued_jobs != NULL && i < num_job_slots; ++i) {
+            struct job *bg = job_slots[i];
+
+            if (bg != NULL && bg != jb && bg->counted) {
+                job_waitid(bg);
+                if (bg->counted)
+                    job_add_pidfds(bg, &fds, &max_fds, &n);
+            }
+        }
+
+        if (poll(fds, n, -1) == -1 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        while (read(chld_fd, &si, sizeof(si)) == sizeof(si))
+            ;
+    }
+
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    free(fds);
+    return ret;
+}
+#endif
+
+/**
+ * Waits until some of the processes of {@jb} have changed state, and
+ * updates them. If they all have a pidfd, only they are waited for, along
+ * with the running background jobs while set -j keeps others queued;
+ * other children are left to jobs_reap(). Otherwise whichever child
+ * changes state first is. Returns -1 if there was none to wait for.
+ */
+static int job_wait_change(struct job *jb)
 {
     int status;
     pid_t pid;
 
+#ifdef HAVE_PIDFD
+    bool pollable = true;
+
+    for (struct proc *p = jb->procs; p != NULL; p = p->next) {
+        if (p->pid != 0 && !p->finished && p->pidfd == -1)
+            pollable = false;
+    }
+
+    if (pollable && chld_fd == -1) {
+        sigset_t chld;
+
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        chld_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    }
+
+    if (pollable && chld_fd != -1) {
+        int ret = job_wait_pidfds(jb);
+
+        if (ret != 1)
+            return ret;
+    }
+#endif
+
+    pid = waitpid(WAIT_ANY, &status, WUNTRACED);
+    return proc_update(pid, status);
+}
+
+void job_wait(struct job *jb)
+{
     /**
      * wait for all processes in the job to finish or stop
      */
-    do {
-        pid = waitpid(WAIT_ANY, &status, WUNTRACED);
-    } while (proc_update(pid, status) == 0
-            && !job_stopped(jb)
-            && !job_finished(jb));
+    while (!job_stopped(jb)
+            && !job_finished(jb)
+            && job_wait_change(jb) == 0)
+        ;
+
+    job_set_status(jb);
 }
 
 void job_background(const struct job *jb, bool to_continue)
 {
     if (to_continue) {
-        if (kill(-jb->pgid, SIGCONT) < 0)
+        if (job_kill(jb, SIGCONT) < 0)
             perror("kill");
     }
 }
@@ -815,7 +1950,7 @@ void job_foreground(struct job *jb, bool to_continue)
     if (to_continue) {
         if (jb->tmodes_saved && tcsetattr(shell_input_fd, TCSADRAIN, &jb->tmodes) < 0)
             perror("tcsetattr");
-        if (kill(-jb->pgid, SIGCONT) < 0)
+        if (job_kill(jb, SIGCONT) < 0)
             perror("kill");
     }
 
@@ -835,11 +1970,28 @@ void job_foreground(struct job *jb, bool to_continue)
 
 void job_continue(struct job *jb, bool background)
 {
+    /* it was never started, so it starts now, whatever set -j says */
+    if (jb->queued) {
+        job_dequeue(jb);
+        jb->is_bg = background;
+        job_start(jb);
+        return;
+    }
+
+    /* a job in the foreground makes room for a queued one */
+    if (background) {
+        job_count(jb);
+    } else {
+        job_uncount(jb);
+        jobs_start_queued();
+    }
+
     for (struct proc *p = jb->procs; p != NULL; p = p->next)
-        p->stopped = false;
+        proc_set_stopped(p, false);
 
     /* we need to notify the user that the job's state has changed */
     jb->notified = false;
+    job_mark_dirty(jb);
 
     jb->is_bg = background;
     if (background)
@@ -848,10 +2000,27 @@ void job_continue(struct job *jb, bool background)
         job_foreground(jb, true);
 }
 
-void jobs_notifications(void)
+void jobs_prefetch(const struct llist *pipelines)
+{
+    if (!opt_prefetch)
+        return;
+
+    for (struct link *ln = pipelines->head; ln != NULL; ln = ln->next) {
+        const struct an_pipeline *pln = ln->data;
+
+        for (struct link *lp = pln->procs->head; lp != NULL; lp = lp->next) {
+            const struct an_process *proc = lp->data;
+            const char *path;
+
+            if (!proc_internal_exists(proc->progname.fname)
+                    && (path = cmdhash_lookup(proc->progname.fname)) != NULL)
+                prefetch_queue(path);
+        }
+    }
+}
+
+bool jobs_reap(void)
 {
-    struct job **jb;
-    int job_id;
     pid_t pid;
     int status;
 
@@ -860,38 +2029,37 @@ void jobs_notifications(void)
         pid = waitpid(WAIT_ANY, &status, WCONTINUED | WUNTRACED | WNOHANG);
     } while (proc_update(pid, status) == 0);
 
-    jb = &jobs;
-    job_id = 1;
-    while (*jb != NULL) {
-        if (job_finished(*jb)) {
-            struct job *job_temp = *jb;
+    for (struct job *jb = dirty_jobs; jb != NULL; jb = jb->next) {
+        /* not when only some of a pipeline's processes are done */
+        if (job_finished(jb) ? jb->is_bg : !jb->notified && job_stopped(jb))
+            return true;
+    }
+    return false;
+}
 
-            /* remove the job from the list */
-            *jb = (*jb)->next;
+void jobs_notifications(void)
+{
+    jobs_reap();
 
-            /* do this just for better debugging */
-            job_temp->next = NULL;
+    /* only the jobs that changed, however many others there are */
+    while (dirty_jobs != NULL) {
+        struct job *jb = dirty_jobs;
 
-            if (job_temp->is_bg)
-                job_display(job_temp, true, false, job_id, STDOUT_FILENO);
+        job_unmark_dirty(jb);
 
-            /* destroy the job */
-            job_destroy(job_temp);
-            continue;   /* don't iterate to next job */
-        }
-        
-        if (!(*jb)->notified) {
-            struct job *job_temp = *jb;
+        if (job_finished(jb)) {
+            if (jb->is_bg)
+                job_display(jb, true, false, STDOUT_FILENO);
 
+            /* destroy the job */
+            job_destroy(jb);
+        } else if (!jb->notified) {
             /* notify the user about a recently stopped job */
-            job_temp->notified = true;
+            jb->notified = true;
 
             /* print information about each process in the job */
-            job_display(job_temp, true, false, job_id, STDOUT_FILENO);
+            job_display(jb, true, false, STDOUT_FILENO);
         }
-
-        jb = &(*jb)->next;
-        ++job_id;
     }
 }
 
@@ -906,11 +2074,11 @@ void jobs_cleanup(void)
     if (getpid() != shell_pgid)
         return;
 
-    while (jobs != NULL) {
-        struct job *next = jobs->next;
-        kill(-jobs->pgid, SIGKILL);
-        job_destroy(jobs);
-        jobs = next;
+    for (size_t i = 0; i < num_job_slots; ++i) {
+        if (job_slots[i] != NULL) {
+            job_kill(job_slots[i], SIGKILL);
+            job_destroy(job_slots[i]);
+        }
     }
 }
 
@@ -924,13 +2092,41 @@ void job_destroy(struct job *jb)
     if (jb->stderr_fd != STDERR_FILENO)
         close(jb->stderr_fd);
 
+    job_unmark_dirty(jb);
+    job_uncount(jb);
+    if (jb->queued)
+        job_dequeue(jb);
+
+    /* give up its id */
+    if (jb->id > 0) {
+        job_slots[jb->id - 1] = NULL;
+        if ((size_t) jb->id - 1 < job_slots_free)
+            job_slots_free = jb->id - 1;
+    }
+    if (jb == cur_job || jb == prev_job) {
+        if (jb == cur_job)
+            cur_job = prev_job;
+        prev_job = NULL;
+        job_pick_current();
+    }
+
     /* destroy process info */
     struct proc *p = jb->procs;
     while (p != NULL) {
         struct proc *p_next = p->next;
 
-        for (size_t i = 0; p->argv[i] != NULL; ++i)
-            free(p->argv[i]);
+        if (p->pid != 0)
+            proc_unindex(p);
+
+        if (p->pidfd != -1)
+            close(p->pidfd);
+        if (p->batch != NULL && p->batch->stage == p) {
+            if (p->batch->fdin != -1)
+                close(p->batch->fdin);
+            if (p->batch->fdout != -1)
+                close(p->batch->fdout);
+            free(p->batch);
+        }
         free(p->argv);
         free(p);
 
@@ -938,6 +2134,8 @@ void job_destroy(struct job *jb)
     }
 
     free(jb->cmdline);
+    free(jb->file_in);
+    free(jb->file_out);
 
     /* finally, destroy the job */
     free(jb);
@@ -5,6 +5,8 @@
 #include <termios.h>
 #include "analyzer.h"
 
+struct job_batch;
+
 struct proc {
     pid_t pid;
 
@@ -12,6 +14,7 @@ struct proc {
      * freed().
      * This is not guaranteed to be unique. */
     char *name;
+    /* The arguments, in one allocation with the strings. */
     char **argv;
 
     bool stopped;
@@ -19,6 +22,15 @@ struct proc {
 
     int status; /* the status value */
 
+    /* refers to the process while it runs, or -1 */
+    int pidfd;
+
+    /* the job the process belongs to */
+    struct job *job;
+
+    /* for a batch stage and its chunks, see job_batch_start() */
+    struct job_batch *batch;
+
     struct proc *next;
 };
 
@@ -26,6 +38,13 @@ struct job {
     /* The process group ID */
     pid_t pgid;
 
+    /**
+     * The number the user refers to the job by, from 1. It is
+     * the lowest one that was free when the job was added, and
+     * stays the job's until it is destroyed.
+     */
+    int id;
+
     int stdin_fd, stdout_fd, stderr_fd;
 
     bool is_bg;
@@ -48,21 +67,65 @@ struct job {
     bool tmodes_saved;
 
     /**
-     * For displaying messages.
+     * For displaying messages: the pipeline as it was typed.
      */
     char *cmdline;
 
     /* List of processes in this pipeline */
     struct proc *procs;
 
-    /* the next job */
+    /* The files to redirect from and to, or NULL */
+    char *file_in, *file_out;
+
+    /**
+     * If the job waits for other background jobs to finish before
+     * it starts, see set -j, and the next one that does.
+     */
+    bool queued;
+    struct job *next_queued;
+
+    /* If it counts as one of the background jobs running */
+    bool counted;
+
+    /**
+     * How many processes there are, and how many of them have
+     * stopped or finished, as proc_update() last heard.
+     */
+    size_t num_procs;
+    size_t num_stopped;
+    size_t num_finished;
+
+    /**
+     * The next job with a state change to report, and the pointer
+     * to this one, which is NULL if it has none.
+     */
     struct job *next;
+    struct job **pprev;
 };
 
 /**
- * Initializes the shell.
+ * Initializes the shell. If {@use_tty} is false, the shell
+ * stays non-interactive even if its input is a terminal.
+ */
+void pcfsh_init(bool use_tty);
+
+/**
+ * Has programs started by a helper process that pcfsh_init() forks
+ * (see zygote.h). Must be called before pcfsh_init().
+ */
+void pcfsh_use_zygote(bool use_zygote);
+
+/**
+ * Whether the shell is reading commands from a terminal.
+ */
+bool pcfsh_interactive(void);
+
+/**
+ * The exit status of the last job that was waited for, or of the last
+ * builtin: what the shell exits with. A program killed by a signal
+ * is 128 plus the signal number.
  */
-void pcfsh_init(void);
+int pcfsh_status(void);
 
 /**
  * Displays the prompt string.
@@ -74,8 +137,29 @@ void pcfsh_prefix(const char *str);
  */
 int job_exec(struct an_pipeline *pln);
 
-/* Returns true if all processes
- * in the job have stopped. */
+/**
+ * Like job_exec(), for the last pipeline the shell runs before it exits.
+ * A single program in the foreground of a non-interactive shell is
+ * exec()d in place of the shell, after its redirections, so that the
+ * shell does not fork only to wait. Otherwise, this is job_exec().
+ */
+int job_exec_last(struct an_pipeline *pln);
+
+/**
+ * Returns true if running {@pln} may read the shell's standard input:
+ * it does not redirect its input, and does not start with a builtin,
+ * other than the ones that start or continue jobs that might.
+ */
+bool job_reads_input(const struct an_pipeline *pln);
+
+/**
+ * If the prefetch option is set, has the programs that {@pipelines}
+ * will run read into memory while the ones before them run (see prefetch.h).
+ */
+void jobs_prefetch(const struct llist *pipelines);
+
+/* Returns true if the job has stopped: none of
+ * its processes are running, and some are stopped. */
 bool job_stopped(const struct job *jb);
 
 /**
@@ -113,6 +197,13 @@ void job_foreground(struct job *jb, bool to_continue);
  */
 void job_continue(struct job *jb, bool background);
 
+/**
+ * Reaps the children that changed state, without waiting for any.
+ * Returns true if a job has finished in the background, or stopped,
+ * and jobs_notifications() has yet to report it.
+ */
+bool jobs_reap(void);
+
 /**
  * If there are any finished jobs, reaps them. Then displays
  * information about any jobs that have changed state
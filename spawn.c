@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+#include "spawn.h"
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+
+/**
+ * glibc 2.35 can give the child the terminal before it execs.
+ */
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#define HAVE_SPAWN_TCSETPGRP
+#endif
+
+/**
+ * glibc 2.34 has close_range(), and a spawn action that calls it.
+ */
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 34)
+#define HAVE_CLOSE_RANGE
+#endif
+
+extern char **environ;
+
+/**
+ * Whether {@error} from posix_spawn() means that the program itself could
+ * not be executed, as opposed to the process not being set up.
+ */
+static bool exec_error(int error)
+{
+    switch (error) {
+        case ENOENT:
+        case EACCES:
+        case ENOEXEC:
+        case ENOTDIR:
+        case ELOOP:
+        case ENAMETOOLONG:
+        case E2BIG:
+        case ETXTBSY:
+        case EISDIR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Makes {@fd} the child's {@target} stream, as proc_exec() does with dup2().
+ */
+static int redirect(posix_spawn_file_actions_t *actions, int fd, int target)
+{
+    int error;
+
+    if (fd == target)
+        return 0;
+    if ((error = posix_spawn_file_actions_adddup2(actions, fd, target)) != 0)
+        return error;
+    return posix_spawn_file_actions_addclose(actions, fd);
+}
+
+int spawn_proc(struct proc *proc, const char *path, pid_t pgid,
+        int fdin, int fdout, int fderr, bool job_control, int tty_fd, int close_from)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigmask;
+    short flags = 0;
+    pid_t pid;
+    int error;
+
+#ifndef HAVE_SPAWN_TCSETPGRP
+    /* the child has to take the terminal before it execs */
+    if (job_control && tty_fd != -1)
+        return SPAWN_UNSUPPORTED;
+#endif
+
+    if (posix_spawn_file_actions_init(&actions) != 0)
+        return SPAWN_UNSUPPORTED;
+    if (posix_spawnattr_init(&attr) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return SPAWN_UNSUPPORTED;
+    }
+
+#ifdef HAVE_SPAWN_TCSETPGRP
+    /* this happens after the child has joined its group, and
+     * before the terminal (which may be stdin) is redirected */
+    if (job_control && tty_fd != -1
+            && (error = posix_spawn_file_actions_addtcsetpgrp_np(&actions, tty_fd)) != 0)
+        goto unsupported;
+#endif
+
+    if ((error = redirect(&actions, fdin, STDIN_FILENO)) != 0
+            || (error = redirect(&actions, fdout, STDOUT_FILENO)) != 0
+            || (error = redirect(&actions, fderr, STDERR_FILENO)) != 0)
+        goto unsupported;
+
+#ifdef HAVE_CLOSE_RANGE
+    if (close_from != -1
+            && (error = posix_spawn_file_actions_addclosefrom_np(&actions, close_from)) != 0)
+        goto unsupported;
+#endif
+
+    if (job_control) {
+        sigset_t sigdefault;
+
+        /* a new group if pgid is 0, as with setpgid() */
+        flags |= POSIX_SPAWN_SETPGROUP;
+        if ((error = posix_spawnattr_setpgroup(&attr, pgid)) != 0)
+            goto unsupported;
+
+        sigemptyset(&sigdefault);
+        sigaddset(&sigdefault, SIGINT);
+        sigaddset(&sigdefault, SIGQUIT);
+        sigaddset(&sigdefault, SIGTSTP);
+        sigaddset(&sigdefault, SIGTTIN);
+        sigaddset(&sigdefault, SIGTTOU);
+        sigaddset(&sigdefault, SIGCHLD);
+        flags |= POSIX_SPAWN_SETSIGDEF;
+        if ((error = posix_spawnattr_setsigdefault(&attr, &sigdefault)) != 0)
+            goto unsupported;
+    }
+
+    /* the shell may have SIGCHLD blocked, see main.c */
+    sigemptyset(&sigmask);
+    flags |= POSIX_SPAWN_SETSIGMASK;
+    if ((error = posix_spawnattr_setsigmask(&attr, &sigmask)) != 0)
+        goto unsupported;
+
+    if ((error = posix_spawnattr_setflags(&attr, flags)) != 0)
+        goto unsupported;
+
+    error = posix_spawn(&pid, path, &actions, &attr, proc->argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (error == 0) {
+        proc->pid = pid;
+        return 0;
+    }
+
+    return exec_error(error) ? error : SPAWN_UNSUPPORTED;
+
+unsupported:
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return SPAWN_UNSUPPORTED;
+}
+
+void spawn_close_from(int fd, bool cloexec)
+{
+#ifdef HAVE_CLOSE_RANGE
+    close_range(fd, ~0U, cloexec ? CLOSE_RANGE_CLOEXEC : 0);
+#endif
+}
@@ -0,0 +1,39 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "shell.h"
+
+/**
+ * What spawn_proc() returns when posix_spawn(3) cannot start the
+ * process the way it has to be started, so it has to be forked.
+ */
+#define SPAWN_UNSUPPORTED (-1)
+
+/**
+ * Starts {@proc} from {@path} with posix_spawn(3), which does not copy
+ * the shell's address space the way fork() does, with {@fdin}, {@fdout}
+ * and {@fderr} as its standard streams; the originals are closed in
+ * the child.
+ * With {@job_control}, the process joins the group {@pgid} (its own
+ * group if this is 0) and gets the default handlers for the signals
+ * the shell ignores; if {@tty_fd} isn't -1, its group is also put in
+ * the foreground of that terminal. The descriptors from {@close_from}
+ * up are closed in the child, unless it is -1.
+ *
+ * Returns 0 and sets proc->pid on success. Returns the errno if the
+ * program could not be executed, which the caller should report, or
+ * SPAWN_UNSUPPORTED if the caller should fork instead.
+ */
+int spawn_proc(struct proc *proc, const char *path, pid_t pgid,
+        int fdin, int fdout, int fderr, bool job_control, int tty_fd, int close_from);
+
+/**
+ * In a child that is about to exec(), closes the descriptors from {@fd}
+ * up, or with {@cloexec} only marks them close-on-exec. Where there is
+ * no close_range(2), they are left open.
+ */
+void spawn_close_from(int fd, bool cloexec);
+
+#endif
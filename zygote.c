@@ -0,0 +1,358 @@
+#define _GNU_SOURCE
+#include "zygote.h"
+#include "spawn.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+/**
+ * A request to start a program. It is followed by {@len} bytes: the path,
+ * then {@argc} arguments and {@envc} environment strings, each ending with
+ * a NUL. The standard streams come with it, as SCM_RIGHTS.
+ */
+struct zygote_request {
+    size_t len;
+    pid_t pgid;
+    int tty_fd;
+    int close_from;
+    unsigned argc;
+    unsigned envc;
+    bool job_control;
+};
+
+struct zygote_reply {
+    pid_t pid;
+    /** The errno if the program could not be executed, or 0. **/
+    int error;
+};
+
+#define ZYGOTE_NUM_FDS 3
+
+/**
+ * The shell's end of the socket, or -1 if there is no helper.
+ */
+static int zygote_fd = -1;
+
+/**
+ * The helper, a child of the shell.
+ */
+static pid_t zygote_pid = -1;
+
+/**
+ * Reads or writes exactly {@len} bytes. Returns false on error or EOF.
+ */
+static bool io_full(int fd, void *buf, size_t len, bool write_it)
+{
+    char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = write_it ? send(fd, p, len, MSG_NOSIGNAL) : read(fd, p, len);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/**
+ * In the new process: does what proc_exec() does, then execs.
+ * Exec errors are written to {@err_fd}.
+ */
+static void zygote_child(const struct zygote_request *req, const char *path,
+        char **argv, char **envp, int fds[ZYGOTE_NUM_FDS], int err_fd)
+{
+    sigset_t sigmask;
+    int error;
+
+    /* nothing the shell blocks stays blocked in the program */
+    sigemptyset(&sigmask);
+    sigprocmask(SIG_SETMASK, &sigmask, NULL);
+
+    if (req->job_control) {
+        pid_t pgid = req->pgid != 0 ? req->pgid : getpid();
+
+        setpgid(0, pgid);
+        if (req->tty_fd != -1)
+            tcsetpgrp(req->tty_fd, pgid);
+
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+    }
+
+    for (int i = 0; i < ZYGOTE_NUM_FDS; ++i) {
+        if (fds[i] != i) {
+            dup2(fds[i], i);
+            close(fds[i]);
+        }
+    }
+
+    /* not closed, since err_fd is one of them */
+    if (req->close_from != -1)
+        spawn_close_from(req->close_from, true);
+
+    execve(path, argv, envp);
+    error = errno;
+    write(err_fd, &error, sizeof(error));
+    _exit(EXIT_FAILURE);
+}
+
+/**
+ * Starts one program. Returns the reply for the shell.
+ */
+static struct zygote_reply zygote_handle(const struct zygote_request *req,
+        char *payload, int fds[ZYGOTE_NUM_FDS])
+{
+    struct zygote_reply reply = { -1, 0 };
+    char **argv = calloc(req->argc + 1, sizeof(*argv));
+    char **envp = calloc(req->envc + 1, sizeof(*envp));
+    const char *path = payload;
+    char *p = payload + strlen(payload) + 1;
+    int err_pipe[2];
+    ssize_t n;
+
+    for (unsigned i = 0; i < req->argc; ++i, p += strlen(p) + 1)
+        argv[i] = p;
+    for (unsigned i = 0; i < req->envc; ++i, p += strlen(p) + 1)
+        envp[i] = p;
+
+    if (pipe2(err_pipe, O_CLOEXEC) == -1) {
+        reply.error = errno;
+        goto out;
+    }
+
+    /* a fork, except that the new process is the shell's child, not ours */
+    reply.pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+    if (reply.pid == 0) {
+        close(err_pipe[0]);
+        zygote_child(req, path, argv, envp, fds, err_pipe[1]);
+    }
+    close(err_pipe[1]);
+
+    if (reply.pid == -1) {
+        reply.error = errno;
+    } else {
+        /* nothing comes through once the program has been executed */
+        do
+            n = read(err_pipe[0], &reply.error, sizeof(reply.error));
+        while (n < 0 && errno == EINTR);
+        if (n != sizeof(reply.error))
+            reply.error = 0;
+    }
+    close(err_pipe[0]);
+
+out:
+    free(argv);
+    free(envp);
+    return reply;
+}
+
+/**
+ * The helper's loop: serve requests until the shell goes away.
+ */
+static void zygote_main(int sock)
+{
+    for (;;) {
+        struct zygote_request req;
+        struct zygote_reply reply;
+        union {
+            struct cmsghdr hdr;
+            char buf[CMSG_SPACE(ZYGOTE_NUM_FDS * sizeof(int))];
+        } control;
+        struct iovec iov = { &req, sizeof(req) };
+        struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.buf,
+            .msg_controllen = sizeof(control.buf)
+        };
+        struct cmsghdr *cmsg;
+        int fds[ZYGOTE_NUM_FDS];
+        char *payload;
+        ssize_t n;
+
+        do
+            n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        while (n < 0 && errno == EINTR);
+
+        /* the rest of the request, if it was split */
+        if (n <= 0 || (n < (ssize_t) sizeof(req)
+                    && !io_full(sock, (char *) &req + n, sizeof(req) - n, false)))
+            _exit(EXIT_SUCCESS);
+
+        cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS
+                || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+            _exit(EXIT_FAILURE);
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+        if ((payload = malloc(req.len)) == NULL || !io_full(sock, payload, req.len, false))
+            _exit(EXIT_FAILURE);
+
+        reply = zygote_handle(&req, payload, fds);
+
+        for (int i = 0; i < ZYGOTE_NUM_FDS; ++i)
+            close(fds[i]);
+        free(payload);
+
+        if (!io_full(sock, &reply, sizeof(reply), true))
+            _exit(EXIT_SUCCESS);
+    }
+}
+
+int zygote_start(void)
+{
+    int sv[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+        perror("socketpair()");
+        return -1;
+    }
+
+    if ((pid = fork()) == -1) {
+        perror("fork()");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1]);
+    }
+
+    close(sv[1]);
+    zygote_fd = sv[0];
+    zygote_pid = pid;
+    return 0;
+}
+
+bool zygote_running(void)
+{
+    return zygote_fd != -1;
+}
+
+void zygote_stop(void)
+{
+    if (zygote_fd != -1) {
+        close(zygote_fd);
+        zygote_fd = -1;
+    }
+
+    /* it exits as soon as it sees the end of the socket */
+    if (zygote_pid != -1) {
+        while (waitpid(zygote_pid, NULL, 0) == -1 && errno == EINTR)
+            ;
+        zygote_pid = -1;
+    }
+}
+
+/**
+ * Appends {@str} and its NUL to the buffer.
+ */
+static void payload_add(char **buf, size_t *len, size_t *capacity, const char *str)
+{
+    size_t size = strlen(str) + 1;
+
+    if (*len + size > *capacity) {
+        while (*len + size > *capacity)
+            *capacity *= 2;
+        *buf = realloc(*buf, *capacity);
+    }
+    memcpy(*buf + *len, str, size);
+    *len += size;
+}
+
+int zygote_spawn(struct proc *proc, const char *path, pid_t pgid,
+        int fdin, int fdout, int fderr, bool job_control, int tty_fd, int close_from)
+{
+    struct zygote_request req = {
+        .pgid = pgid,
+        .tty_fd = tty_fd,
+        .close_from = close_from,
+        .job_control = job_control
+    };
+    struct zygote_reply reply;
+    int fds[ZYGOTE_NUM_FDS] = { fdin, fdout, fderr };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf)
+    };
+    struct cmsghdr *cmsg;
+    size_t capacity = 4096;
+    char *payload = malloc(capacity);
+    bool sent;
+    ssize_t n;
+
+    if (zygote_fd == -1 || payload == NULL) {
+        free(payload);
+        return SPAWN_UNSUPPORTED;
+    }
+
+    payload_add(&payload, &req.len, &capacity, path);
+    for (char **arg = proc->argv; *arg != NULL; ++arg, ++req.argc)
+        payload_add(&payload, &req.len, &capacity, *arg);
+    for (char **env = environ; *env != NULL; ++env, ++req.envc)
+        payload_add(&payload, &req.len, &capacity, *env);
+
+    memset(&control, 0, sizeof(control));
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    do
+        n = sendmsg(zygote_fd, &msg, MSG_NOSIGNAL);
+    while (n < 0 && errno == EINTR);
+
+    sent = n >= 0
+        && io_full(zygote_fd, (char *) &req + n, sizeof(req) - n, true)
+        && io_full(zygote_fd, payload, req.len, true);
+    free(payload);
+
+    if (!sent || !io_full(zygote_fd, &reply, sizeof(reply), false)) {
+        /* the helper is gone; do without it */
+        close(zygote_fd);
+        zygote_fd = -1;
+        return SPAWN_UNSUPPORTED;
+    }
+
+    if (reply.pid == -1)
+        return SPAWN_UNSUPPORTED;
+
+    if (reply.error != 0) {
+        /* it is our child, and it has exited */
+        waitpid(reply.pid, NULL, 0);
+        return reply.error;
+    }
+
+    proc->pid = reply.pid;
+    return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "shell.h"
+
+/**
+ * A small helper process that starts programs for the shell.
+ *
+ * The helper is forked while the shell is still small, and it starts
+ * each program with a fork of its own, so that how much memory the
+ * shell has grown to does not make starting programs any slower.
+ * The programs are made children of the shell rather than of the helper
+ * (see CLONE_PARENT in clone(2)), so the shell waits for them as usual.
+ */
+
+/**
+ * Forks the helper. Returns 0, or -1 if it could not be started.
+ */
+int zygote_start(void);
+
+/**
+ * Whether the helper is running.
+ */
+bool zygote_running(void);
+
+/**
+ * Has the helper exit, and reaps it. Called before the shell exec()s a
+ * program in its place, which would otherwise be left with the helper
+ * as a child it never started.
+ */
+void zygote_stop(void);
+
+/**
+ * Has the helper start {@proc} from {@path}, with the same arguments
+ * and results as spawn_proc(). If the helper is gone, returns
+ * SPAWN_UNSUPPORTED.
+ */
+int zygote_spawn(struct proc *proc, const char *path, pid_t pgid,
+        int fdin, int fdout, int fderr, bool job_control, int tty_fd, int close_from);
+
+#endif